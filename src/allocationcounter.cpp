@@ -0,0 +1,58 @@
+#include "allocationcounter.h"
+#include <atomic>
+#include <cstdlib>
+
+#if defined(PEXELMANAGER_COUNT_ALLOCATIONS) && defined(__GLIBC__)
+#define ALLOCATION_COUNTING 1
+#endif
+
+namespace {
+
+std::atomic<quint64> s_allocations{0};
+
+}
+
+bool AllocationCounter::enabled()
+{
+#ifdef ALLOCATION_COUNTING
+    return true;
+#else
+    return false;
+#endif
+}
+
+quint64 AllocationCounter::count()
+{
+    return s_allocations.load(std::memory_order_relaxed);
+}
+
+#ifdef ALLOCATION_COUNTING
+
+// Interpose glibc's allocator; the executable's definitions win for Qt and libstdc++ too
+extern "C" {
+
+void* __libc_malloc(size_t size) noexcept;
+void* __libc_calloc(size_t count, size_t size) noexcept;
+void* __libc_realloc(void* ptr, size_t size) noexcept;
+
+void* malloc(size_t size) noexcept
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) noexcept
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) noexcept
+{
+    s_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+}
+
+#endif
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <QtGlobal>
+
+// Process-wide count of heap allocations (malloc, calloc, realloc, and so every
+// operator new and Qt container), for measuring allocation churn. Only active when
+// built with -DPEXELMANAGER_COUNT_ALLOCATIONS=ON on glibc; otherwise enabled() is
+// false and count() stays 0.
+namespace AllocationCounter {
+
+bool enabled();
+quint64 count();
+
+}
@@ -0,0 +1,160 @@
+#include "bandwidthscheduler.h"
+#include "settings.h"
+#include <QTime>
+
+BandwidthScheduler& BandwidthScheduler::instance()
+{
+    static BandwidthScheduler instance;
+    return instance;
+}
+
+BandwidthScheduler::BandwidthScheduler()
+{
+    m_clock.start();
+
+    // No class has been active yet
+    for (int i = 0; i < ClassCount; ++i) {
+        m_lastActivity[i] = -ACTIVITY_WINDOW_MS;
+    }
+}
+
+void BandwidthScheduler::applySettings()
+{
+    auto& settings = Settings::instance();
+
+    setGlobalCap(settings.bandwidthCapKBps("global") * 1024LL);
+    setClassCap(Bulk, settings.bandwidthCapKBps("bulk") * 1024LL);
+    setClassCap(Preview, settings.bandwidthCapKBps("preview") * 1024LL);
+    setClassCap(Thumbnail, settings.bandwidthCapKBps("thumbnail") * 1024LL);
+    setClassCap(Api, settings.bandwidthCapKBps("api") * 1024LL);
+    setPeakPolicy(settings.bandwidthPeakStartHour(), settings.bandwidthPeakEndHour(),
+                  settings.bandwidthCapKBps("peak_bulk") * 1024LL);
+}
+
+void BandwidthScheduler::setGlobalCap(qint64 bytesPerSecond)
+{
+    QMutexLocker locker(&m_mutex);
+    m_globalCap = qMax<qint64>(0, bytesPerSecond);
+}
+
+void BandwidthScheduler::setClassCap(TrafficClass cls, qint64 bytesPerSecond)
+{
+    QMutexLocker locker(&m_mutex);
+    m_classCaps[cls] = qMax<qint64>(0, bytesPerSecond);
+}
+
+void BandwidthScheduler::setPeakPolicy(int startHour, int endHour, qint64 bulkBytesPerSecond)
+{
+    QMutexLocker locker(&m_mutex);
+    m_peakStartHour = startHour;
+    m_peakEndHour = endHour;
+    m_peakBulkCap = qMax<qint64>(0, bulkBytesPerSecond);
+}
+
+qint64 BandwidthScheduler::acquire(TrafficClass cls, qint64 wanted)
+{
+    if (wanted <= 0) return 0;
+
+    QMutexLocker locker(&m_mutex);
+    refill();
+
+    if (cls != Bulk) {
+        m_lastActivity[cls] = m_clock.elapsed();
+        m_intervalBytes[cls] += wanted;
+        return wanted;
+    }
+
+    qint64 granted = wanted;
+    if (bulkRate() > 0) {
+        granted = qMin(wanted, static_cast<qint64>(m_bulkTokens));
+        m_bulkTokens -= granted;
+    }
+    m_intervalBytes[Bulk] += granted;
+    return granted;
+}
+
+void BandwidthScheduler::consume(TrafficClass cls, qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    refill();
+    m_lastActivity[cls] = m_clock.elapsed();
+    m_intervalBytes[cls] += bytes;
+}
+
+void BandwidthScheduler::setActive(TrafficClass cls, bool active)
+{
+    QMutexLocker locker(&m_mutex);
+    m_forcedActive[cls] = active;
+    m_lastActivity[cls] = m_clock.elapsed();
+}
+
+void BandwidthScheduler::setExpectedRate(TrafficClass cls, qint64 bytesPerSecond)
+{
+    QMutexLocker locker(&m_mutex);
+    m_expectedRate[cls] = qMax<qint64>(0, bytesPerSecond);
+}
+
+qint64 BandwidthScheduler::currentBulkRate()
+{
+    QMutexLocker locker(&m_mutex);
+    return bulkRate();
+}
+
+void BandwidthScheduler::refill()
+{
+    qint64 now = m_clock.elapsed();
+    qint64 elapsed = now - m_lastRefill;
+    if (elapsed <= 0) return;
+    m_lastRefill = now;
+
+    // Smooth per-class usage so reservations follow what interactive traffic really uses
+    for (int i = 0; i < ClassCount; ++i) {
+        double rate = m_intervalBytes[i] * 1000.0 / elapsed;
+        m_measuredRate[i] = 0.8 * m_measuredRate[i] + 0.2 * rate;
+        m_intervalBytes[i] = 0;
+    }
+
+    qint64 rate = bulkRate();
+    if (rate > 0) {
+        // Allow at most a quarter second of burst
+        double burst = qMax(rate / 4.0, 64.0 * 1024);
+        m_bulkTokens = qMin(burst, m_bulkTokens + rate * elapsed / 1000.0);
+    }
+}
+
+qint64 BandwidthScheduler::bulkRate() const
+{
+    qint64 rate = (isPeak() && m_peakBulkCap > 0) ? m_peakBulkCap : m_classCaps[Bulk];
+
+    if (m_globalCap > 0) {
+        qint64 reserved = 0;
+        for (int i = 0; i < ClassCount; ++i) {
+            auto cls = static_cast<TrafficClass>(i);
+            if (cls == Bulk || !isActive(cls)) continue;
+            reserved += m_classCaps[cls] > 0
+                ? m_classCaps[cls] : qMax(static_cast<qint64>(m_measuredRate[cls]), m_expectedRate[cls]);
+        }
+        // Bulk keeps a trickle so it never stalls completely
+        qint64 left = qMax(m_globalCap - reserved, m_globalCap / 20);
+        rate = rate > 0 ? qMin(rate, left) : left;
+    }
+
+    return rate;
+}
+
+bool BandwidthScheduler::isPeak() const
+{
+    if (m_peakStartHour == m_peakEndHour) return false;
+
+    int hour = QTime::currentTime().hour();
+    if (m_peakStartHour < m_peakEndHour) {
+        return hour >= m_peakStartHour && hour < m_peakEndHour;
+    }
+    // Window wraps past midnight
+    return hour >= m_peakStartHour || hour < m_peakEndHour;
+}
+
+bool BandwidthScheduler::isActive(TrafficClass cls) const
+{
+    return m_forcedActive[cls] || m_clock.elapsed() - m_lastActivity[cls] < ACTIVITY_WINDOW_MS;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <QtGlobal>
+#include <QMutex>
+#include <QElapsedTimer>
+
+// Shares the link between traffic classes. Bulk downloads are paced through
+// token buckets and only read what acquire() grants. Interactive classes (API,
+// thumbnails, previews) are never delayed, so their caps are soft: while a class
+// is active its cap, or without one its measured or expected rate, is reserved
+// out of the global budget and bulk transfers get whatever is left.
+class BandwidthScheduler
+{
+public:
+    enum TrafficClass { Api, Thumbnail, Preview, Bulk, ClassCount };
+
+    static BandwidthScheduler& instance();
+
+    // Reload caps and the time-of-day policy from Settings
+    void applySettings();
+
+    // Caps in bytes per second, 0 = unlimited
+    void setGlobalCap(qint64 bytesPerSecond);
+    void setClassCap(TrafficClass cls, qint64 bytesPerSecond);
+
+    // Bulk cap used instead of the normal one between startHour and endHour (local time)
+    void setPeakPolicy(int startHour, int endHour, qint64 bulkBytesPerSecond);
+
+    // Returns how many of the wanted bytes may be read now
+    qint64 acquire(TrafficClass cls, qint64 wanted);
+
+    // Interactive traffic is accounted, not paced
+    void consume(TrafficClass cls, qint64 bytes);
+    void setActive(TrafficClass cls, bool active);
+
+    // Rate a class needs while active when its traffic is not seen here (e.g. a
+    // preview streamed by the media player); reserved if above the measured rate
+    void setExpectedRate(TrafficClass cls, qint64 bytesPerSecond);
+
+    qint64 currentBulkRate();
+
+private:
+    BandwidthScheduler();
+    BandwidthScheduler(const BandwidthScheduler&) = delete;
+    BandwidthScheduler& operator=(const BandwidthScheduler&) = delete;
+
+    void refill();
+    qint64 bulkRate() const;
+    bool isPeak() const;
+    bool isActive(TrafficClass cls) const;
+
+    static const int ACTIVITY_WINDOW_MS = 2000;
+
+    QMutex m_mutex;
+    QElapsedTimer m_clock;
+    qint64 m_lastRefill = 0;
+
+    qint64 m_globalCap = 0;
+    qint64 m_classCaps[ClassCount] = {};
+    int m_peakStartHour = 0;
+    int m_peakEndHour = 0;
+    qint64 m_peakBulkCap = 0;
+
+    double m_bulkTokens = 0.0;
+    qint64 m_lastActivity[ClassCount] = {};
+    bool m_forcedActive[ClassCount] = {};
+    double m_measuredRate[ClassCount] = {};
+    qint64 m_expectedRate[ClassCount] = {};
+    qint64 m_intervalBytes[ClassCount] = {};
+};
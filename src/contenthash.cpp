@@ -0,0 +1,157 @@
+#include "contenthash.h"
+#include <QFile>
+#include <QtEndian>
+#include <cstring>
+
+namespace {
+
+const quint64 PRIME1 = 11400714785074694791ULL;
+const quint64 PRIME2 = 14029467366897019727ULL;
+const quint64 PRIME3 = 1609587929392839161ULL;
+const quint64 PRIME4 = 9650029242287828579ULL;
+const quint64 PRIME5 = 2870177450012600261ULL;
+
+inline quint64 rotl(quint64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline quint64 read64(const char* p)
+{
+    return qFromLittleEndian<quint64>(p);
+}
+
+inline quint32 read32(const char* p)
+{
+    return qFromLittleEndian<quint32>(p);
+}
+
+inline quint64 mixRound(quint64 acc, quint64 input)
+{
+    acc += input * PRIME2;
+    acc = rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+inline quint64 mergeRound(quint64 acc, quint64 value)
+{
+    acc ^= mixRound(0, value);
+    return acc * PRIME1 + PRIME4;
+}
+
+}
+
+ContentHash::ContentHash(quint64 seed)
+    : m_seed(seed)
+{
+    reset();
+}
+
+void ContentHash::reset()
+{
+    m_acc[0] = m_seed + PRIME1 + PRIME2;
+    m_acc[1] = m_seed + PRIME2;
+    m_acc[2] = m_seed;
+    m_acc[3] = m_seed - PRIME1;
+    m_buffered = 0;
+    m_length = 0;
+}
+
+void ContentHash::addData(const char* data, qint64 length)
+{
+    if (length <= 0) return;
+    m_length += length;
+
+    // Top up a partial stripe first
+    if (m_buffered > 0) {
+        int take = static_cast<int>(qMin<qint64>(32 - m_buffered, length));
+        memcpy(m_buffer + m_buffered, data, take);
+        m_buffered += take;
+        data += take;
+        length -= take;
+        if (m_buffered < 32) return;
+
+        for (int i = 0; i < 4; ++i) {
+            m_acc[i] = mixRound(m_acc[i], read64(m_buffer + i * 8));
+        }
+        m_buffered = 0;
+    }
+
+    while (length >= 32) {
+        for (int i = 0; i < 4; ++i) {
+            m_acc[i] = mixRound(m_acc[i], read64(data + i * 8));
+        }
+        data += 32;
+        length -= 32;
+    }
+
+    if (length > 0) {
+        memcpy(m_buffer, data, length);
+        m_buffered = static_cast<int>(length);
+    }
+}
+
+quint64 ContentHash::result() const
+{
+    quint64 h;
+    if (m_length >= 32) {
+        h = rotl(m_acc[0], 1) + rotl(m_acc[1], 7) + rotl(m_acc[2], 12) + rotl(m_acc[3], 18);
+        for (int i = 0; i < 4; ++i) {
+            h = mergeRound(h, m_acc[i]);
+        }
+    } else {
+        h = m_seed + PRIME5;
+    }
+    h += static_cast<quint64>(m_length);
+
+    const char* p = m_buffer;
+    int remaining = m_buffered;
+    while (remaining >= 8) {
+        h ^= mixRound(0, read64(p));
+        h = rotl(h, 27) * PRIME1 + PRIME4;
+        p += 8;
+        remaining -= 8;
+    }
+    if (remaining >= 4) {
+        h ^= static_cast<quint64>(read32(p)) * PRIME1;
+        h = rotl(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+        remaining -= 4;
+    }
+    while (remaining > 0) {
+        h ^= static_cast<quint8>(*p) * PRIME5;
+        h = rotl(h, 11) * PRIME1;
+        p++;
+        remaining--;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+bool ContentHash::hashFile(const QString& path, quint64& hash, qint64* size)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    ContentHash hasher;
+    QByteArray buffer(1024 * 1024, Qt::Uninitialized);
+    qint64 read;
+    while ((read = file.read(buffer.data(), buffer.size())) > 0) {
+        hasher.addData(buffer.constData(), read);
+    }
+    if (read < 0) return false;
+
+    hash = hasher.result();
+    if (size) *size = hasher.length();
+    return true;
+}
+
+QString ContentHash::toHex(quint64 hash)
+{
+    return QString("%1").arg(hash, 16, 16, QChar('0'));
+}
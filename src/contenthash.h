@@ -0,0 +1,31 @@
+#pragma once
+
+#include <QtGlobal>
+#include <QString>
+
+// Streaming XXH64. Fast enough to hash media files at disk speed; used as the
+// content address in the media store, not for anything security related.
+class ContentHash
+{
+public:
+    explicit ContentHash(quint64 seed = 0);
+
+    void reset();
+    void addData(const char* data, qint64 length);
+    void addData(const QByteArray& data) { addData(data.constData(), data.size()); }
+
+    quint64 result() const;
+    qint64 length() const { return m_length; }
+
+    // Whole-file convenience; returns false if the file cannot be read
+    static bool hashFile(const QString& path, quint64& hash, qint64* size = nullptr);
+
+    static QString toHex(quint64 hash);
+
+private:
+    quint64 m_seed;
+    quint64 m_acc[4];
+    char m_buffer[32];
+    int m_buffered = 0;
+    qint64 m_length = 0;
+};
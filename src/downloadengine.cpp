@@ -0,0 +1,1487 @@
+#include "downloadengine.h"
+#include "bandwidthscheduler.h"
+#include "mediastore.h"
+#include "networkservice.h"
+#include "uploadmanager.h"
+#include <QFileInfo>
+#include <QDir>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QDebug>
+#include <QRandomGenerator>
+#include <algorithm>
+#include <iterator>
+
+DownloadEngine::DownloadEngine(QObject* parent)
+    : QObject(parent)
+    , m_network(this)
+    , m_pacingTimer(this)
+    , m_progressTimer(this)
+    , m_wakeupTimer(this)
+    , m_controlTimer(this)
+{
+    // Parented so they follow moveToThread() to the download thread
+    m_controlTimer.setInterval(CONTROL_INTERVAL_MS);
+    connect(&m_controlTimer, &QTimer::timeout, this, &DownloadEngine::onControlTick);
+
+    m_pacingTimer.setSingleShot(true);
+    m_pacingTimer.setInterval(PACING_INTERVAL_MS);
+    connect(&m_pacingTimer, &QTimer::timeout, this, &DownloadEngine::onPacingTick);
+
+    m_progressTimer.setSingleShot(true);
+    m_progressTimer.setInterval(PROGRESS_INTERVAL_MS);
+    connect(&m_progressTimer, &QTimer::timeout, this, &DownloadEngine::flushProgress);
+
+    m_wakeupTimer.setSingleShot(true);
+    connect(&m_wakeupTimer, &QTimer::timeout, this, &DownloadEngine::startDownloads);
+    m_clock.start();
+
+    // One writer keeps block writes and progress snapshots in submission order
+    m_writePool.setMaxThreadCount(1);
+}
+
+DownloadEngine::~DownloadEngine()
+{
+    m_writePool.waitForDone();
+}
+
+DownloadEngine::WriteStats DownloadEngine::writeStats() const
+{
+    WriteStats stats;
+    stats.writeCalls = m_writeCalls;
+    stats.bytesWritten = m_bytesWritten;
+    return stats;
+}
+
+void DownloadEngine::setConcurrencyBounds(int minimum, int maximum)
+{
+    m_minWindow = qMax(1, minimum);
+    m_maxWindow = qMax(m_minWindow, maximum);
+    m_window = qBound(m_minWindow, m_window, m_maxWindow);
+    if (isDownloading()) {
+        startDownloads();
+    }
+}
+
+void DownloadEngine::downloadMedia(int mediaId, const QUrl& url, const QString& destPath,
+                                   DownloadEngine::Priority priority, qint64 expectedBytes,
+                                   const QString& storeKey)
+{
+    // Two transfers on one .part file would truncate or rename it under each other
+    if (hasTaskFor(destPath)) {
+        emit downloadError(mediaId, QString("Already downloading to %1").arg(destPath));
+        return;
+    }
+
+    DownloadTask task;
+    task.mediaId = mediaId;
+    task.url = url;
+    task.destPath = destPath;
+    task.priority = priority;
+    task.expectedBytes = expectedBytes;
+    task.storeKey = storeKey;
+    task.sequence = m_nextSequence++;
+
+    m_queue.insert(std::upper_bound(m_queue.begin(), m_queue.end(), task, runsBefore), task);
+    scheduleStart();
+}
+
+void DownloadEngine::ingestMedia(int mediaId, const QUrl& url, const QStringList& ffmpegArgs,
+                                 const QStringList& outputPaths, const QString& rawPath,
+                                 DownloadEngine::Priority priority, qint64 expectedBytes)
+{
+    QString outputPath = outputPaths.value(0);
+    if (hasTaskFor(outputPath)) {
+        emit downloadError(mediaId, QString("Already downloading to %1").arg(outputPath));
+        return;
+    }
+
+    DownloadTask task;
+    task.mediaId = mediaId;
+    task.url = url;
+    task.destPath = outputPath;
+    task.priority = priority;
+    task.expectedBytes = expectedBytes;
+    task.sequence = m_nextSequence++;
+    task.ffmpegArgs = ffmpegArgs;
+    task.outputPaths = outputPaths;
+    task.rawPath = rawPath;
+
+    m_queue.insert(std::upper_bound(m_queue.begin(), m_queue.end(), task, runsBefore), task);
+    scheduleStart();
+}
+
+QString DownloadEngine::partialOutputPath(const QString& path)
+{
+    QFileInfo info(path);
+    return info.path() + "/" + info.completeBaseName() + ".part." + info.suffix();
+}
+
+void DownloadEngine::warmUp(const QStringList& hosts)
+{
+    for (const QString& host : hosts) {
+        m_network.connectToHostEncrypted(host);
+    }
+}
+
+void DownloadEngine::boost(int mediaId)
+{
+    for (int i = 0; i < m_queue.size(); ++i) {
+        if (m_queue[i].mediaId != mediaId) continue;
+
+        DownloadTask task = m_queue.takeAt(i);
+        task.priority = Interactive;
+        task.boost = m_nextBoost++;
+        m_queue.insert(std::upper_bound(m_queue.begin(), m_queue.end(), task, runsBefore), task);
+        qDebug() << "Boosted download" << mediaId << "from position" << i;
+        return;
+    }
+}
+
+void DownloadEngine::setHedgingEnabled(bool enabled)
+{
+    m_hedging = enabled;
+}
+
+void DownloadEngine::setIngestLimit(int maxStreams)
+{
+    m_maxIngests = qMax(1, maxStreams);
+    if (isDownloading()) {
+        startDownloads();
+    }
+}
+
+void DownloadEngine::setPaused(bool paused)
+{
+    m_paused = paused;
+    if (!paused) {
+        startDownloads();
+    }
+}
+
+bool DownloadEngine::runsBefore(const DownloadTask& a, const DownloadTask& b)
+{
+    if (a.boost != b.boost) return a.boost > b.boost;
+    if (a.priority != b.priority) return a.priority < b.priority;
+
+    bool aKnown = a.expectedBytes >= 0;
+    bool bKnown = b.expectedBytes >= 0;
+    if (aKnown != bKnown) return aKnown;
+    if (aKnown && a.expectedBytes != b.expectedBytes) return a.expectedBytes < b.expectedBytes;
+
+    return a.sequence < b.sequence;
+}
+
+void DownloadEngine::cancelAll()
+{
+    m_queue.clear();
+    m_circuits.clear();
+    m_wakeupTimer.stop();
+
+    // Partial files and their resume info are kept so the next attempt can continue
+    for (int transferId : m_transfers.keys()) {
+        failTransfer(transferId, QString(), true);
+    }
+
+    // A stream cannot be resumed; drop it with its partial output
+    for (auto reply : m_streams.keys()) {
+        failIngest(reply, QString());
+    }
+}
+
+void DownloadEngine::startDownloads()
+{
+    while (activeCount() < m_window) {
+        // Every transfer keeps at least one connection so split files never stall
+        if (startPendingSegment(true)) continue;
+
+        // Tasks for hosts behind an open circuit wait their turn, and so do ingests
+        // while their encodes would exceed the CPU budget
+        bool ingestFull = m_streams.size() >= m_maxIngests;
+        int next = -1;
+        for (int i = 0; i < m_queue.size() && next < 0 && !m_paused; ++i) {
+            if (ingestFull && !m_queue[i].ffmpegArgs.isEmpty()) continue;
+            if (hostAvailable(m_queue[i].url.host())) next = i;
+        }
+        if (next >= 0) {
+            startTask(m_queue.takeAt(next));
+            continue;
+        }
+
+        // Queue drained: lend the idle connections to remaining segments of large files
+        if (startPendingSegment(false)) continue;
+        if (m_queue.isEmpty() && m_hedging && hedgeStraggler()) continue;
+        break;
+    }
+
+    scheduleWakeup();
+
+    if (activeCount() > 0 && !m_controlTimer.isActive()) {
+        m_intervalBytes = 0;
+        m_intervalErrors = 0;
+        m_intervalClock.start();
+        m_controlTimer.start();
+    }
+
+    // Check if all done
+    if (m_transfers.isEmpty() && m_streams.isEmpty() && m_queue.isEmpty()) {
+        m_controlTimer.stop();
+        m_throughput = 0.0;
+
+        WriteStats stats = writeStats();
+        if (stats.writeCalls > 0) {
+            qDebug() << "Download writes:" << stats.writeCalls << "calls," << stats.bytesWritten
+                     << "bytes," << stats.bytesWritten / stats.writeCalls << "bytes/write";
+        }
+        emit transferStatsChanged(m_window, 0, 0.0);
+        emit allDownloadsCompleted();
+    }
+}
+
+void DownloadEngine::onControlTick()
+{
+    qint64 elapsed = m_intervalClock.restart();
+    if (elapsed <= 0) return;
+
+    double rate = m_intervalBytes * 1000.0 / elapsed;
+    m_throughput = (m_throughput == 0.0) ? rate : 0.7 * m_throughput + 0.3 * rate;
+    int errors = m_intervalErrors;
+    m_intervalBytes = 0;
+    m_intervalErrors = 0;
+
+    if (errors > 0) {
+        // Multiplicative decrease on failures and timeouts
+        m_window = qMax(m_minWindow, m_window / 2);
+        m_probing = false;
+        m_holdTicks = 3;
+    } else if (m_holdTicks > 0) {
+        m_holdTicks--;
+    } else if (m_probing && m_throughput < m_probeBaseline * 1.05) {
+        // The last extra connection bought no throughput; give it back and hold
+        m_window = qMax(m_minWindow, m_window - 1);
+        m_probing = false;
+        m_holdTicks = 5;
+    } else if (activeCount() >= m_window && m_window < m_maxWindow) {
+        // Additive increase while every slot is busy
+        m_probeBaseline = m_throughput;
+        m_window++;
+        m_probing = true;
+    } else {
+        m_probing = false;
+    }
+
+    emit transferStatsChanged(m_window, activeCount(), m_throughput);
+    checkStalledRequests();
+    startDownloads();
+}
+
+void DownloadEngine::onPacingTick()
+{
+    for (auto reply : m_requests.keys()) {
+        if (m_requests.contains(reply) && reply->bytesAvailable() > 0) {
+            writeSegmentData(reply);
+        }
+    }
+    for (auto reply : m_streams.keys()) {
+        pumpIngest(reply);
+    }
+}
+
+void DownloadEngine::startTask(const DownloadTask& task)
+{
+    // Ensure directory exists
+    QFileInfo info(task.destPath);
+    QDir dir = info.absoluteDir();
+    if (!dir.exists()) {
+        dir.mkpath(".");
+    }
+
+    if (!task.ffmpegArgs.isEmpty()) {
+        startIngest(task);
+        return;
+    }
+
+    // Check if file already exists
+    if (QFile::exists(task.destPath)) {
+        emit downloadCompleted(task.mediaId, task.destPath);
+        return;
+    }
+
+    // Another project may already have fetched the same rendition
+    QString storedHash;
+    qint64 storedSize = 0;
+    if (!task.storeKey.isEmpty()
+        && MediaStore::instance().checkout(task.storeKey, task.destPath, &storedHash, &storedSize)) {
+        qDebug() << "Linked" << task.storeKey << "from media store";
+        emit downloadVerified(task.mediaId, storedSize, storedHash);
+        emit downloadCompleted(task.mediaId, task.destPath);
+        return;
+    }
+
+    QString tempPath = task.destPath + ".part";
+
+    // Resume only when the partial file came from the same URL and has a validator
+    PartInfo part;
+    bool resume = readPartInfo(tempPath, part) && part.url == task.url.toString()
+        && !part.validator().isEmpty();
+    if (resume) {
+        // Without preallocation the file size is more current than the last saved position
+        if (!part.preallocated && part.segments.size() == 1) {
+            part.segments[0].pos = QFileInfo(tempPath).size();
+        }
+    } else {
+        removePartial(tempPath);
+        part = PartInfo();
+        part.url = task.url.toString();
+        part.segments.append(Segment());
+    }
+
+    // A previous run may have received everything but stopped before the rename
+    bool allDone = true;
+    for (const auto& seg : part.segments) {
+        allDone = allDone && seg.isDone();
+    }
+    if (resume && allDone) {
+        QFile::remove(partInfoPath(tempPath));
+        if (QFile::rename(tempPath, task.destPath)) {
+            emit downloadCompleted(task.mediaId, task.destPath);
+        } else {
+            emit downloadError(task.mediaId, "Failed to rename downloaded file");
+        }
+        return;
+    }
+
+    // Readable as well: completeHash() reads back ranges that were not hashed on arrival
+    QIODevice::OpenMode mode = QIODevice::ReadWrite;
+    if (!resume) mode |= QIODevice::Truncate;
+    QFile* file = new QFile(tempPath);
+    if (!file->open(mode)) {
+        emit downloadError(task.mediaId,
+            QString("Cannot create file: %1").arg(tempPath));
+        delete file;
+        return;
+    }
+
+    emit downloadStarted(task.mediaId);
+
+    Transfer transfer;
+    transfer.task = task;
+    transfer.file = file;
+    transfer.hash = std::make_shared<HashState>();
+    transfer.part = part;
+    transfer.resolvedUrl = task.url;
+
+    // Data from an earlier run is read back on the writer thread as the prefix reaches it
+    for (const auto& seg : part.segments) {
+        if (seg.pos > seg.start) markWritten(*transfer.hash, seg.start, seg.pos);
+    }
+    m_transfers.insert(m_nextTransferId++, transfer);
+
+    // The first segment request is sent by the scheduler in startDownloads()
+}
+
+void DownloadEngine::startIngest(const DownloadTask& task)
+{
+    // Outputs only get their final names on a clean exit, so existing ones are complete
+    bool done = true;
+    for (const QString& path : task.outputPaths) {
+        done = done && QFile::exists(path);
+    }
+    if (done) {
+        emit ingestCompleted(task.mediaId, task.destPath, QString());
+        return;
+    }
+
+    IngestStream stream;
+    stream.task = task;
+
+    if (!task.rawPath.isEmpty()) {
+        QDir().mkpath(QFileInfo(task.rawPath).absolutePath());
+        stream.tee = new QFile(task.rawPath + ".part");
+        if (!stream.tee->open(QIODevice::WriteOnly)) {
+            delete stream.tee;
+            emit downloadError(task.mediaId, QString("Cannot create file: %1.part").arg(task.rawPath));
+            return;
+        }
+    }
+
+    QNetworkRequest request(task.url);
+    NetworkService::prepareRequest(request, BandwidthScheduler::Bulk);
+    QNetworkReply* reply = m_network.get(request);
+    reply->setReadBufferSize(READ_BUFFER_SIZE);
+
+    stream.ffmpeg = new QProcess(this);
+    UploadManager::lowerPriority(stream.ffmpeg);
+    connect(stream.ffmpeg, &QProcess::bytesWritten, this, [this, reply]() {
+        pumpIngest(reply);
+    });
+    connect(stream.ffmpeg, &QProcess::readyReadStandardError, this, [this, reply]() {
+        auto it = m_streams.find(reply);
+        if (it == m_streams.end()) return;
+
+        // Only the tail is kept: the end of the log is where ffmpeg says what went wrong
+        QByteArray& tail = it->stderrTail;
+        tail += it->ffmpeg->readAllStandardError();
+        if (tail.size() > UploadManager::STDERR_TAIL_BYTES) {
+            tail.remove(0, tail.size() - UploadManager::STDERR_TAIL_BYTES);
+        }
+    });
+    connect(stream.ffmpeg, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+            this, [this, reply](int exitCode, QProcess::ExitStatus status) {
+        onIngestProcessFinished(reply, exitCode, status);
+    });
+    connect(stream.ffmpeg, &QProcess::errorOccurred, this, [this, reply](QProcess::ProcessError error) {
+        if (error == QProcess::FailedToStart) {
+            failIngest(reply, "Failed to start ffmpeg");
+            startDownloads();
+        }
+    });
+
+    connect(reply, &QNetworkReply::readyRead, this, [this, reply]() {
+        pumpIngest(reply);
+    });
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() {
+        onIngestReplyFinished(reply);
+    });
+
+    m_streams.insert(reply, stream);
+    emit downloadStarted(task.mediaId);
+    stream.ffmpeg->start("ffmpeg", task.ffmpegArgs);
+}
+
+void DownloadEngine::pumpIngest(QNetworkReply* reply)
+{
+    auto it = m_streams.find(reply);
+    if (it == m_streams.end()) return;
+    IngestStream& stream = *it;
+
+    if (!stream.headersChecked) {
+        QVariant statusAttr = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+        if (!statusAttr.isValid()) return;
+        stream.headersChecked = true;
+
+        int status = statusAttr.toInt();
+        if (status < 500 && status != 408 && status != 429) {
+            recordHostResult(reply->url().host(), true);
+        }
+        if (status != 200) {
+            failIngest(reply, QString("HTTP %1").arg(status));
+            startDownloads();
+            return;
+        }
+        stream.total = reply->header(QNetworkRequest::ContentLengthHeader).toLongLong();
+        if (stream.total <= 0) stream.total = -1;
+    }
+
+    while (reply->bytesAvailable() > 0) {
+        // ffmpeg sets the pace: data stays in the socket until it has consumed what it has
+        if (stream.ffmpeg->bytesToWrite() >= INGEST_PIPE_LIMIT) return;
+
+        qint64 available = qMin(reply->bytesAvailable(), READ_BUFFER_SIZE);
+        qint64 granted = stream.networkDone
+            ? available
+            : BandwidthScheduler::instance().acquire(BandwidthScheduler::Bulk, available);
+        if (granted <= 0) {
+            if (!m_pacingTimer.isActive()) {
+                m_pacingTimer.start();
+            }
+            return;
+        }
+
+        QByteArray data = reply->read(granted);
+        if (data.isEmpty()) break;
+
+        stream.ffmpeg->write(data);
+        if (stream.tee) {
+            stream.tee->write(data);
+        }
+        stream.hasher.addData(data);
+        stream.received += data.size();
+        m_intervalBytes += data.size();
+    }
+
+    DownloadProgress progress;
+    progress.mediaId = stream.task.mediaId;
+    progress.received = stream.received;
+    progress.total = stream.total;
+    m_pendingProgress[progress.mediaId] = progress;
+    if (!m_progressTimer.isActive()) {
+        m_progressTimer.start();
+    }
+
+    // Body fully handed over: EOF tells ffmpeg to finish the file
+    if (stream.networkDone && reply->bytesAvailable() == 0
+        && stream.ffmpeg->state() == QProcess::Running) {
+        stream.ffmpeg->closeWriteChannel();
+    }
+}
+
+void DownloadEngine::onIngestReplyFinished(QNetworkReply* reply)
+{
+    auto it = m_streams.find(reply);
+    if (it == m_streams.end()) return;
+
+    if (reply->error() != QNetworkReply::NoError) {
+        int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (status == 0 || status >= 500) {
+            m_intervalErrors++;
+            recordHostResult(reply->url().host(), false);
+        }
+        failIngest(reply, QString("Download failed: %1").arg(reply->errorString()));
+        startDownloads();
+        return;
+    }
+
+    it->networkDone = true;
+    pumpIngest(reply);
+}
+
+void DownloadEngine::onIngestProcessFinished(QNetworkReply* reply, int exitCode, QProcess::ExitStatus status)
+{
+    auto it = m_streams.find(reply);
+    if (it == m_streams.end()) return;
+    IngestStream& stream = *it;
+
+    if (status != QProcess::NormalExit || exitCode != 0 || !stream.networkDone) {
+        stream.stderrTail += stream.ffmpeg->readAllStandardError();
+        QString output = QString::fromUtf8(stream.stderrTail.right(UploadManager::STDERR_TAIL_BYTES)).trimmed();
+        failIngest(reply, QString("ffmpeg failed on streamed input: %1").arg(output.right(500)));
+        startDownloads();
+        return;
+    }
+    if (stream.total >= 0 && stream.received != stream.total) {
+        failIngest(reply, QString("Size mismatch: received %1 of %2 bytes").arg(stream.received).arg(stream.total));
+        startDownloads();
+        return;
+    }
+
+    const QStringList outputPaths = stream.task.outputPaths;  // failIngest() drops the stream
+    for (const QString& path : outputPaths) {
+        QFile::remove(path);
+        if (!QFile::rename(partialOutputPath(path), path)) {
+            failIngest(reply, QString("Failed to rename encoded file %1").arg(path));
+            startDownloads();
+            return;
+        }
+    }
+
+    QString rawPath;
+    if (stream.tee) {
+        stream.tee->close();
+        QFile::remove(stream.task.rawPath);
+        if (QFile::rename(stream.tee->fileName(), stream.task.rawPath)) {
+            rawPath = stream.task.rawPath;
+            emit downloadVerified(stream.task.mediaId, stream.received, ContentHash::toHex(stream.hasher.result()));
+        }
+    }
+
+    DownloadTask task = stream.task;
+    removeIngest(reply);
+    emit ingestCompleted(task.mediaId, task.destPath, rawPath);
+    startDownloads();
+}
+
+void DownloadEngine::failIngest(QNetworkReply* reply, const QString& error)
+{
+    auto it = m_streams.find(reply);
+    if (it == m_streams.end()) return;
+
+    int mediaId = it->task.mediaId;
+    QStringList outputPaths = it->task.outputPaths;
+    QString teePath = it->tee ? it->tee->fileName() : QString();
+
+    removeIngest(reply);
+    for (const QString& path : outputPaths) {
+        QFile::remove(partialOutputPath(path));
+        QFile::remove(path);  // Renamed already if the failure came after ffmpeg
+    }
+    if (!teePath.isEmpty()) {
+        QFile::remove(teePath);
+    }
+
+    if (!error.isEmpty()) {
+        emit downloadError(mediaId, error);
+    }
+}
+
+void DownloadEngine::removeIngest(QNetworkReply* reply)
+{
+    IngestStream stream = m_streams.take(reply);
+    m_pendingProgress.remove(stream.task.mediaId);
+
+    reply->disconnect(this);
+    if (!reply->isFinished()) {
+        reply->abort();
+    }
+    reply->deleteLater();
+
+    stream.ffmpeg->disconnect(this);
+    if (stream.ffmpeg->state() != QProcess::NotRunning) {
+        stream.ffmpeg->kill();
+        stream.ffmpeg->waitForFinished(1000);
+    }
+    stream.ffmpeg->deleteLater();
+
+    if (stream.tee) {
+        stream.tee->close();
+        delete stream.tee;
+    }
+}
+
+bool DownloadEngine::startPendingSegment(bool idleTransfersOnly)
+{
+    qint64 now = m_clock.elapsed();
+    for (auto it = m_transfers.begin(); it != m_transfers.end(); ++it) {
+        if (idleTransfersOnly && it->activeRequests > 0) continue;
+        if (!hostAvailable(it->resolvedUrl.host())) continue;
+
+        for (int i = 0; i < it->part.segments.size(); ++i) {
+            const Segment& seg = it->part.segments[i];
+            if (!seg.requested && !seg.isDone() && seg.retryAt <= now) {
+                sendSegmentRequest(it.key(), i);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void DownloadEngine::sendSegmentRequest(int transferId, int segment)
+{
+    Transfer& transfer = m_transfers[transferId];
+    Segment& seg = transfer.part.segments[segment];
+    seg.requested = true;
+
+    QNetworkRequest request(transfer.resolvedUrl);
+    NetworkService::prepareRequest(request, BandwidthScheduler::Bulk);
+
+    if (seg.pos > 0 || seg.end >= 0) {
+        QByteArray range = "bytes=" + QByteArray::number(seg.pos) + "-";
+        if (seg.end >= 0) {
+            range += QByteArray::number(seg.end);
+        }
+        request.setRawHeader("Range", range);
+        if (!transfer.part.validator().isEmpty()) {
+            request.setRawHeader("If-Range", transfer.part.validator());
+        }
+    }
+
+    QNetworkReply* reply = m_network.get(request);
+    reply->setReadBufferSize(READ_BUFFER_SIZE);
+
+    SegmentRequest segmentRequest;
+    segmentRequest.transferId = transferId;
+    segmentRequest.segment = segment;
+    segmentRequest.host = transfer.resolvedUrl.host();
+    segmentRequest.startPos = seg.pos;
+    segmentRequest.lastActivity = m_clock.elapsed();
+    m_requests.insert(reply, segmentRequest);
+    transfer.activeRequests++;
+
+    // The first request to a host whose circuit has cooled down is its probe
+    auto circuit = m_circuits.find(segmentRequest.host);
+    if (circuit != m_circuits.end() && circuit->open) {
+        circuit->probing = true;
+    }
+
+    connect(reply, &QNetworkReply::readyRead, this, [this, reply]() {
+        writeSegmentData(reply);
+    });
+    connect(reply, &QNetworkReply::finished,
+            this, &DownloadEngine::onRequestFinished);
+}
+
+bool DownloadEngine::handleResponseHeaders(QNetworkReply* reply, SegmentRequest& request)
+{
+    if (request.headersHandled) return request.acceptBody;
+
+    QVariant statusAttr = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+    if (!statusAttr.isValid()) return false;  // No response yet (e.g. connection failed)
+    request.headersHandled = true;
+
+    // Error bodies must never end up in the partial file
+    int status = statusAttr.toInt();
+    if (status < 500 && status != 408 && status != 429) {
+        recordHostResult(request.host, true);
+    }
+    if (status != 200 && status != 206) return false;
+
+    int transferId = request.transferId;
+    Transfer& transfer = m_transfers[transferId];
+    Segment seg = transfer.part.segments[request.segment];
+    bool ranged = seg.pos > 0 || seg.end >= 0;
+    qint64 contentLength = reply->header(QNetworkRequest::ContentLengthHeader).toLongLong();
+
+    if (ranged && status == 200) {
+        // Server ignored the range or the validator no longer matches: the whole
+        // partial file is stale. Continue with this full response from byte 0.
+        qDebug() << "Range not honoured for" << transfer.task.url << "- restarting from 0";
+        abortRequests(transferId, reply);
+        resetTransfer(transfer);
+        transfer.activeRequests = 1;
+        transfer.part.segments[0].requested = true;
+        request.segment = 0;
+        request.startPos = 0;
+        seg = transfer.part.segments[0];
+        ranged = false;
+    } else if (ranged) {
+        // 206 must continue exactly where the segment stands: "bytes start-end/total"
+        QByteArray contentRange = reply->rawHeader("Content-Range");
+        int space = contentRange.indexOf(' ');
+        int dash = contentRange.indexOf('-');
+        int slash = contentRange.indexOf('/');
+        qint64 rangeStart = (space >= 0 && dash > space)
+            ? contentRange.mid(space + 1, dash - space - 1).toLongLong() : -1;
+        if (rangeStart != seg.pos) {
+            failTransfer(transferId, QString("Unexpected Content-Range: %1")
+                .arg(QString::fromLatin1(contentRange)), false);
+            startDownloads();
+            return false;
+        }
+        bool ok = false;
+        qint64 total = slash >= 0 ? contentRange.mid(slash + 1).toLongLong(&ok) : -1;
+        if (ok && total > 0) {
+            transfer.part.total = total;
+        }
+    }
+
+    request.acceptBody = true;
+
+    if (!ranged) {
+        transfer.part.total = contentLength > 0 ? contentLength : -1;
+        transfer.part.etag = reply->rawHeader("ETag");
+        transfer.part.lastModified = reply->rawHeader("Last-Modified");
+        transfer.resolvedUrl = reply->url();
+    }
+
+    Segment& current = transfer.part.segments[request.segment];
+    if (current.end < 0 && transfer.part.total > 0) {
+        current.end = transfer.part.total - 1;
+    }
+
+    // Reserve the full length up front so block writes never extend the file
+    if (transfer.part.total > 0 && !transfer.part.preallocated) {
+        transfer.file->resize(transfer.part.total);
+        transfer.part.preallocated = true;
+    }
+
+    // Large files with range support are split so idle connections can help
+    bool acceptsRanges = status == 206 || reply->rawHeader("Accept-Ranges") == "bytes";
+    if (acceptsRanges && !transfer.part.validator().isEmpty() && transfer.part.segments.size() == 1
+        && current.end >= 0 && current.end - current.pos + 1 >= MIN_SEGMENTED_SIZE) {
+        splitSegment(transfer, request.segment);
+    }
+
+    saveProgress(transferId);
+    return true;
+}
+
+void DownloadEngine::splitSegment(Transfer& transfer, int segment)
+{
+    qint64 total = transfer.part.total;
+    qint64 splitAt = transfer.part.segments[segment].pos + SEGMENT_SIZE;
+    if (splitAt >= total) return;
+
+    if (!transfer.part.preallocated) {
+        transfer.file->resize(total);
+        transfer.part.preallocated = true;
+    }
+
+    // The running request keeps the first segment and is stopped once it is filled
+    transfer.part.segments[segment].end = splitAt - 1;
+
+    for (qint64 start = splitAt; start < total; start += SEGMENT_SIZE) {
+        Segment seg;
+        seg.start = start;
+        seg.pos = start;
+        seg.end = qMin(start + SEGMENT_SIZE, total) - 1;
+        transfer.part.segments.append(seg);
+    }
+}
+
+void DownloadEngine::writeSegmentData(QNetworkReply* reply)
+{
+    auto it = m_requests.find(reply);
+    if (it == m_requests.end() || it->complete) return;
+    if (!handleResponseHeaders(reply, *it)) return;
+
+    // Header handling may have restarted or failed the transfer
+    it = m_requests.find(reply);
+    if (it == m_requests.end()) return;
+    auto transferIt = m_transfers.find(it->transferId);
+    if (transferIt == m_transfers.end()) return;
+
+    Transfer& transfer = *transferIt;
+    SegmentRequest& request = *it;
+    Segment& seg = transfer.part.segments[request.segment];
+
+    // Too much data is waiting for the disk: leave the rest in the socket for now
+    if (m_pendingBlocks >= MAX_PENDING_BLOCKS && !reply->isFinished()) {
+        if (!m_pacingTimer.isActive()) {
+            m_pacingTimer.start();
+        }
+        return;
+    }
+
+    qint64 available = reply->bytesAvailable();
+    if (seg.end >= 0) {
+        available = qMin(available, seg.end - seg.pos + 1);
+    }
+
+    // Bulk reads are paced by the bandwidth scheduler; whatever is left waits for the next tick
+    qint64 granted = reply->isFinished()
+        ? available
+        : BandwidthScheduler::instance().acquire(BandwidthScheduler::Bulk, available);
+    if (granted < available && !m_pacingTimer.isActive()) {
+        m_pacingTimer.start();
+    }
+
+    // Read straight into pooled blocks instead of allocating per network chunk
+    qint64 remaining = granted;
+    while (remaining > 0) {
+        if (request.buffer.isEmpty()) {
+            request.buffer = acquireBuffer();
+            request.bufferOffset = seg.pos;
+            request.fill = 0;
+        }
+
+        // The first block of a run is shortened so the following ones land on aligned offsets
+        qint64 limit = WRITE_BLOCK_SIZE - (request.bufferOffset % WRITE_BLOCK_SIZE);
+        qint64 read = reply->read(request.buffer.data() + request.fill, qMin(limit - request.fill, remaining));
+        if (read <= 0) break;
+
+        request.lastActivity = m_clock.elapsed();
+        request.fill += read;
+        seg.pos += read;
+        remaining -= read;
+        m_intervalBytes += read;
+        transfer.bytesSinceSave += read;
+
+        if (request.fill == limit) {
+            submitBuffer(transfer, request);
+        }
+    }
+
+    if (seg.isDone()) {
+        submitBuffer(transfer, request);
+    }
+    if (transfer.bytesSinceSave >= SAVE_PROGRESS_INTERVAL) {
+        saveProgress(request.transferId);
+    }
+
+    queueProgress(transfer);
+
+    if (seg.isDone() && !reply->isFinished()) {
+        // Segment filled by an open-ended request; stop it so the connection frees up
+        request.complete = true;
+        reply->abort();
+    }
+}
+
+void DownloadEngine::onRequestFinished()
+{
+    auto reply = qobject_cast<QNetworkReply*>(sender());
+    if (!reply || !m_requests.contains(reply)) return;
+
+    // Write any remaining data
+    writeSegmentData(reply);
+
+    reply->deleteLater();
+    if (!m_requests.contains(reply)) {
+        // Transfer was restarted or failed while handling the data
+        startDownloads();
+        return;
+    }
+
+    SegmentRequest request = m_requests.take(reply);
+    auto transferIt = m_transfers.find(request.transferId);
+    if (transferIt == m_transfers.end()) {
+        startDownloads();
+        return;
+    }
+
+    Transfer& transfer = *transferIt;
+    transfer.activeRequests--;
+    submitBuffer(transfer, request);
+    Segment& seg = transfer.part.segments[request.segment];
+    seg.requested = false;
+
+    bool ok = request.complete || (reply->error() == QNetworkReply::NoError && request.acceptBody);
+    if (ok && seg.end < 0 && seg.pos > 0) {
+        // Length was unknown until the server closed the stream
+        seg.end = seg.pos - 1;
+        transfer.part.total = seg.pos;
+    }
+
+    if (!ok || !seg.isDone()) {
+        // Keep the partial file for a ranged retry if the server gave us a validator
+        int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        bool resumable = transfer.part.total > 0 && !transfer.part.validator().isEmpty() && status != 416;
+
+        // Everything but a deliberate cancel and a 4xx rejection is retried: transport errors
+        // (which can arrive after a 2xx header, so status alone misses them), stall aborts,
+        // short bodies, 408, 429 and 5xx. Other 4xx responses will not change on a retry.
+        bool cancelled = reply->error() == QNetworkReply::OperationCanceledError && !request.stalled;
+        bool rejected = status >= 400 && status < 500 && status != 408 && status != 429;
+        bool transient = request.stalled || (!cancelled && !rejected);
+
+        // Server-side and transport failures shrink the concurrency window and count against the host
+        if (transient) {
+            m_intervalErrors++;
+            recordHostResult(request.host, false);
+        }
+
+        QString error;
+        if (request.stalled) {
+            error = QString("Download stalled: no data for %1 s").arg(STALL_TIMEOUT_MS / 1000);
+        } else if (reply->error() == QNetworkReply::NoError) {
+            error = "Download incomplete";
+        } else if (!cancelled) {
+            error = QString("Download failed: %1").arg(reply->errorString());
+        }
+
+        if (seg.pos > request.startPos) {
+            transfer.failures = 0;  // It was making progress
+        }
+        if (transient && transfer.failures < MAX_RETRIES) {
+            qDebug() << "Transfer" << transfer.task.mediaId << "-" << error;
+            int retryAfter = reply->rawHeader("Retry-After").toInt();
+            scheduleRetry(request.transferId, request.segment, resumable, retryAfter);
+        } else {
+            failTransfer(request.transferId, error, resumable);
+        }
+    } else {
+        transfer.failures = 0;
+        bool allDone = true;
+        for (const auto& s : transfer.part.segments) {
+            allDone = allDone && s.isDone();
+        }
+        if (allDone && transfer.activeRequests == 0) {
+            finishTransfer(request.transferId);
+        } else {
+            saveProgress(request.transferId);
+        }
+    }
+
+    // Start more downloads if available
+    startDownloads();
+}
+
+void DownloadEngine::finishTransfer(int transferId)
+{
+    Transfer transfer = m_transfers.take(transferId);
+    m_pendingProgress.remove(transfer.task.mediaId);
+
+    // Every block of this file has to be on disk before the rename
+    m_writePool.waitForDone();
+
+    QString tempPath = transfer.file->fileName();
+    bool writeFailed = transfer.file->error() != QFileDevice::NoError;
+    QString writeError = transfer.file->errorString();
+
+    // What arrived must add up to Content-Length before the file is accepted
+    qint64 received = 0;
+    for (const auto& seg : transfer.part.segments) {
+        received += seg.pos - seg.start;
+    }
+    qint64 expected = transfer.part.total;
+    bool truncated = expected >= 0 && (received != expected || transfer.file->size() != expected);
+
+    QString hash;
+    bool hashFailed = false;
+    if (!writeFailed && !truncated) {
+        quint64 value = 0;
+        hashFailed = !completeHash(transfer, value);
+        if (!hashFailed) hash = ContentHash::toHex(value);
+    }
+
+    transfer.file->close();
+    delete transfer.file;
+
+    if (writeFailed) {
+        removePartial(tempPath);
+        emit downloadError(transfer.task.mediaId, QString("Write failed: %1").arg(writeError));
+        return;
+    }
+    if (truncated) {
+        removePartial(tempPath);
+        emit downloadError(transfer.task.mediaId,
+                           QString("Size mismatch: received %1 of %2 bytes").arg(received).arg(expected));
+        return;
+    }
+    if (hashFailed) {
+        // A wrong hash would poison the media store and the upload manifest
+        removePartial(tempPath);
+        emit downloadError(transfer.task.mediaId, "Could not read back downloaded file");
+        return;
+    }
+
+    // Rename temp file to final
+    QFile::remove(partInfoPath(tempPath));
+    QFile::remove(transfer.task.destPath);  // Remove if exists
+    if (QFile::rename(tempPath, transfer.task.destPath)) {
+        if (!transfer.task.storeKey.isEmpty()
+            && !MediaStore::instance().adopt(transfer.task.storeKey, transfer.task.destPath, hash, received)) {
+            qDebug() << "Could not add" << transfer.task.storeKey << "to media store";
+        }
+        emit downloadVerified(transfer.task.mediaId, received, hash);
+        emit downloadCompleted(transfer.task.mediaId, transfer.task.destPath);
+    } else {
+        emit downloadError(transfer.task.mediaId, "Failed to rename downloaded file");
+    }
+}
+
+void DownloadEngine::failTransfer(int transferId, const QString& error, bool keepPartial)
+{
+    if (keepPartial) {
+        // Buffered data is still good; write it so the resume point moves forward
+        Transfer& active = m_transfers[transferId];
+        for (auto it = m_requests.begin(); it != m_requests.end(); ++it) {
+            if (it->transferId == transferId) {
+                submitBuffer(active, *it);
+            }
+        }
+    }
+
+    abortRequests(transferId);
+    Transfer transfer = m_transfers.take(transferId);
+    m_pendingProgress.remove(transfer.task.mediaId);
+    m_writePool.waitForDone();
+
+    QString tempPath = transfer.file->fileName();
+    transfer.file->close();
+    delete transfer.file;
+
+    if (keepPartial) {
+        for (auto& seg : transfer.part.segments) {
+            seg.requested = false;
+        }
+        writePartInfo(tempPath, transfer.part);
+    } else {
+        removePartial(tempPath);
+    }
+
+    if (!error.isEmpty()) {
+        emit downloadError(transfer.task.mediaId, error);
+    }
+}
+
+void DownloadEngine::abortRequests(int transferId, QNetworkReply* except)
+{
+    for (auto reply : m_requests.keys()) {
+        if (reply == except || m_requests[reply].transferId != transferId) continue;
+        SegmentRequest request = m_requests.take(reply);
+        releaseBuffer(request.buffer);
+
+        // An abandoned probe must not keep its host blocked
+        auto circuit = m_circuits.find(request.host);
+        if (circuit != m_circuits.end()) {
+            circuit->probing = false;
+        }
+        reply->disconnect(this);
+        reply->abort();
+        reply->deleteLater();
+    }
+}
+
+void DownloadEngine::resetTransfer(Transfer& transfer)
+{
+    m_writePool.waitForDone();
+    transfer.part.segments = { Segment() };
+    transfer.part.preallocated = false;
+    transfer.part.total = -1;
+    transfer.file->resize(0);
+    transfer.hash->hasher.reset();
+    transfer.hash->hashedUpTo = 0;
+    transfer.hash->written.clear();
+}
+
+void DownloadEngine::scheduleRetry(int transferId, int segment, bool resumable, int retryAfterSeconds)
+{
+    Transfer& transfer = m_transfers[transferId];
+    int attempt = transfer.failures++;
+
+    // Equal jitter: half the exponential step is fixed, the other half random,
+    // so retries from a burst of failures spread out
+    int step = static_cast<int>(qMin<qint64>(RETRY_MAX_DELAY_MS, qint64(RETRY_BASE_DELAY_MS) << attempt));
+    int delay = step / 2 + QRandomGenerator::global()->bounded(step / 2 + 1);
+    delay = qMax(delay, qMin(retryAfterSeconds, RETRY_MAX_DELAY_MS / 1000) * 1000);
+
+    if (!resumable) {
+        // Nothing to continue from; the next attempt starts over
+        resetTransfer(transfer);
+        segment = 0;
+    }
+
+    transfer.part.segments[segment].retryAt = m_clock.elapsed() + delay;
+    qDebug() << "Retrying" << transfer.task.mediaId << "in" << delay << "ms, attempt" << attempt + 1
+             << "of" << MAX_RETRIES;
+    if (resumable) {
+        saveProgress(transferId);
+    }
+}
+
+void DownloadEngine::scheduleWakeup()
+{
+    qint64 now = m_clock.elapsed();
+    qint64 earliest = -1;
+    auto consider = [&](qint64 time) {
+        if (time > now && (earliest < 0 || time < earliest)) earliest = time;
+    };
+
+    for (const auto& transfer : m_transfers) {
+        for (const auto& seg : transfer.part.segments) {
+            if (!seg.requested && !seg.isDone()) consider(seg.retryAt);
+        }
+    }
+    for (const auto& circuit : m_circuits) {
+        if (circuit.open) consider(circuit.openUntil);
+    }
+
+    if (earliest >= 0) {
+        m_wakeupTimer.start(static_cast<int>(earliest - now));
+    }
+}
+
+bool DownloadEngine::hasTaskFor(const QString& destPath) const
+{
+    for (const auto& task : m_queue) {
+        if (task.destPath == destPath) return true;
+    }
+    for (const auto& transfer : m_transfers) {
+        if (transfer.task.destPath == destPath) return true;
+    }
+    for (const auto& stream : m_streams) {
+        if (stream.task.destPath == destPath) return true;
+    }
+    return false;
+}
+
+void DownloadEngine::scheduleStart()
+{
+    // Each request arrives as its own queued call. Starting once the whole batch is in
+    // lets the first window go to the best-ranked items rather than the first submitted.
+    if (m_startScheduled) return;
+    m_startScheduled = true;
+    QMetaObject::invokeMethod(this, [this]() {
+        m_startScheduled = false;
+        startDownloads();
+    }, Qt::QueuedConnection);
+}
+
+void DownloadEngine::checkStalledRequests()
+{
+    qint64 now = m_clock.elapsed();
+    for (auto reply : m_requests.keys()) {
+        auto it = m_requests.find(reply);
+        if (it == m_requests.end() || it->complete) continue;
+
+        // Data waiting in the socket means we are the bottleneck (pacing, disk), not the server
+        if (reply->bytesAvailable() > 0) {
+            it->lastActivity = now;
+            continue;
+        }
+        if (now - it->lastActivity >= STALL_TIMEOUT_MS) {
+            it->stalled = true;
+            reply->abort();
+        }
+    }
+}
+
+bool DownloadEngine::hedgeStraggler()
+{
+    // Pick the running request with the most left to do
+    QNetworkReply* straggler = nullptr;
+    qint64 mostRemaining = 0;
+    for (auto it = m_requests.cbegin(); it != m_requests.cend(); ++it) {
+        if (!it->acceptBody || it->complete) continue;
+        const Transfer& transfer = m_transfers[it->transferId];
+        if (transfer.part.validator().isEmpty() || transfer.part.total <= 0) continue;
+
+        const Segment& seg = transfer.part.segments[it->segment];
+        qint64 remaining = seg.end - seg.pos + 1;
+        if (seg.end >= 0 && remaining >= 2 * HEDGE_MIN_BYTES && remaining > mostRemaining) {
+            straggler = it.key();
+            mostRemaining = remaining;
+        }
+    }
+    if (!straggler) return false;
+
+    // Its request stops at the new end by itself; the second half goes to an idle connection
+    const SegmentRequest& request = m_requests[straggler];
+    Transfer& transfer = m_transfers[request.transferId];
+    Segment& seg = transfer.part.segments[request.segment];
+    qint64 splitAt = seg.pos + mostRemaining / 2;
+
+    Segment tail;
+    tail.start = splitAt;
+    tail.pos = splitAt;
+    tail.end = seg.end;
+    seg.end = splitAt - 1;
+    transfer.part.segments.append(tail);
+
+    qDebug() << "Hedging" << transfer.task.mediaId << "- second connection takes" << tail.end - tail.start + 1
+             << "bytes";
+    saveProgress(request.transferId);
+    return true;
+}
+
+bool DownloadEngine::hostAvailable(const QString& host) const
+{
+    auto it = m_circuits.constFind(host);
+    if (it == m_circuits.constEnd() || !it->open) return true;
+    return !it->probing && m_clock.elapsed() >= it->openUntil;
+}
+
+void DownloadEngine::recordHostResult(const QString& host, bool success)
+{
+    if (success) {
+        auto it = m_circuits.find(host);
+        if (it != m_circuits.end()) {
+            if (it->open) {
+                qDebug() << "Circuit closed for" << host;
+            }
+            m_circuits.erase(it);
+        }
+        return;
+    }
+
+    HostCircuit& circuit = m_circuits[host];
+    circuit.failures++;
+    if (circuit.open && circuit.probing) {
+        // Probe failed: stay open, and wait longer next time
+        circuit.probing = false;
+        circuit.openMs = qMin(circuit.openMs * 2, qint64(CIRCUIT_MAX_OPEN_MS));
+        circuit.openUntil = m_clock.elapsed() + circuit.openMs;
+        qDebug() << "Circuit for" << host << "stays open for" << circuit.openMs << "ms";
+    } else if (!circuit.open && circuit.failures >= CIRCUIT_FAILURE_THRESHOLD) {
+        circuit.open = true;
+        circuit.openUntil = m_clock.elapsed() + circuit.openMs;
+        qDebug() << "Circuit opened for" << host << "after" << circuit.failures << "failures";
+    }
+}
+
+void DownloadEngine::queueProgress(const Transfer& transfer)
+{
+    DownloadProgress progress;
+    progress.mediaId = transfer.task.mediaId;
+    progress.total = transfer.part.total;
+    for (const auto& seg : transfer.part.segments) {
+        progress.received += seg.pos - seg.start;
+    }
+    m_pendingProgress[progress.mediaId] = progress;
+
+    if (!m_progressTimer.isActive()) {
+        m_progressTimer.start();
+    }
+}
+
+void DownloadEngine::flushProgress()
+{
+    if (m_pendingProgress.isEmpty()) return;
+
+    emit progressBatch(m_pendingProgress.values());
+    m_pendingProgress.clear();
+}
+
+void DownloadEngine::submitBuffer(Transfer& transfer, SegmentRequest& request)
+{
+    if (request.fill == 0) return;
+
+    QFile* file = transfer.file;
+    std::shared_ptr<HashState> hash = transfer.hash;
+    qint64 offset = request.bufferOffset;
+    qint64 length = request.fill;
+    QByteArray block = request.buffer;
+    request.buffer = QByteArray();
+    request.fill = 0;
+
+    m_pendingBlocks++;
+    m_writePool.start([this, file, hash, offset, length, block]() mutable {
+        file->seek(offset);
+        qint64 written = file->write(block.constData(), length);
+        m_writeCalls++;
+        if (written > 0) {
+            m_bytesWritten += written;
+        }
+
+        // Blocks are hashed while still in memory as long as they extend the prefix in order
+        if (written == length) {
+            if (offset == hash->hashedUpTo) {
+                hash->hasher.addData(block.constData(), length);
+                hash->hashedUpTo += length;
+            } else if (offset > hash->hashedUpTo) {
+                markWritten(*hash, offset, offset + length);
+            }
+            advanceHash(file, *hash);
+        }
+        releaseBuffer(std::move(block));
+        m_pendingBlocks--;
+    });
+}
+
+void DownloadEngine::markWritten(HashState& state, qint64 start, qint64 end)
+{
+    // Merged with the ranges it overlaps or touches
+    auto it = state.written.upperBound(start);
+    if (it != state.written.begin()) {
+        auto previous = std::prev(it);
+        if (previous.value() >= start) {
+            start = previous.key();
+            end = qMax(end, previous.value());
+            it = state.written.erase(previous);
+        }
+    }
+    while (it != state.written.end() && it.key() <= end) {
+        end = qMax(end, it.value());
+        it = state.written.erase(it);
+    }
+    state.written.insert(start, end);
+}
+
+void DownloadEngine::advanceHash(QFile* file, HashState& state)
+{
+    // Runs on the writer thread, the only user of file while the transfer is active
+    while (!state.written.isEmpty() && state.written.firstKey() <= state.hashedUpTo) {
+        qint64 end = state.written.first();
+        state.written.erase(state.written.begin());
+        if (end <= state.hashedUpTo || !file->seek(state.hashedUpTo)) continue;
+
+        QByteArray buffer = acquireBuffer();
+        while (state.hashedUpTo < end) {
+            qint64 read = file->read(buffer.data(), qMin<qint64>(buffer.size(), end - state.hashedUpTo));
+            if (read <= 0) break;  // completeHash() notices the short prefix
+            state.hasher.addData(buffer.constData(), read);
+            state.hashedUpTo += read;
+        }
+        releaseBuffer(std::move(buffer));
+        if (state.hashedUpTo < end) return;
+    }
+}
+
+bool DownloadEngine::completeHash(Transfer& transfer, quint64& hash)
+{
+    // The writer thread has advanced the hash over every range by now
+    HashState& state = *transfer.hash;
+    qint64 size = transfer.file->size();
+
+    // Only a failed read-back leaves the running hash covering just a prefix
+    if (state.hashedUpTo != size) {
+        qDebug() << "Incremental hash stopped at" << state.hashedUpTo << "of" << size
+                 << "bytes for" << transfer.task.mediaId << "- hashing the whole file";
+        transfer.file->flush();
+        return ContentHash::hashFile(transfer.file->fileName(), hash);
+    }
+
+    hash = state.hasher.result();
+    return true;
+}
+
+void DownloadEngine::saveProgress(int transferId)
+{
+    Transfer& transfer = m_transfers[transferId];
+    transfer.bytesSinceSave = 0;
+
+    // Bytes still sitting in request buffers are not durable yet
+    PartInfo snapshot = transfer.part;
+    for (auto it = m_requests.cbegin(); it != m_requests.cend(); ++it) {
+        if (it->transferId == transferId) {
+            snapshot.segments[it->segment].pos -= it->fill;
+        }
+    }
+
+    // Queued behind the blocks already submitted, so it never points past written data
+    QString tempPath = transfer.file->fileName();
+    m_writePool.start([tempPath, snapshot]() {
+        writePartInfo(tempPath, snapshot);
+    });
+}
+
+QByteArray DownloadEngine::acquireBuffer()
+{
+    QMutexLocker locker(&m_bufferMutex);
+    if (!m_freeBuffers.isEmpty()) {
+        return m_freeBuffers.takeLast();
+    }
+    return QByteArray(WRITE_BLOCK_SIZE, Qt::Uninitialized);
+}
+
+void DownloadEngine::releaseBuffer(QByteArray buffer)
+{
+    if (buffer.size() != WRITE_BLOCK_SIZE) return;
+
+    QMutexLocker locker(&m_bufferMutex);
+    if (m_freeBuffers.size() < MAX_PENDING_BLOCKS) {
+        m_freeBuffers.append(std::move(buffer));
+    }
+}
+
+QString DownloadEngine::partInfoPath(const QString& tempPath)
+{
+    return tempPath + ".json";
+}
+
+bool DownloadEngine::readPartInfo(const QString& tempPath, PartInfo& info)
+{
+    if (!QFile::exists(tempPath)) return false;
+
+    QFile file(partInfoPath(tempPath));
+    if (!file.open(QIODevice::ReadOnly)) return false;
+
+    QJsonObject obj = QJsonDocument::fromJson(file.readAll()).object();
+    info.url = obj["url"].toString();
+    info.etag = obj["etag"].toString().toUtf8();
+    info.lastModified = obj["last_modified"].toString().toUtf8();
+    info.total = obj["total"].toInteger(-1);
+    info.preallocated = obj["preallocated"].toBool();
+
+    for (const auto& s : obj["segments"].toArray()) {
+        QJsonObject segObj = s.toObject();
+        Segment seg;
+        seg.start = segObj["start"].toInteger();
+        seg.end = segObj["end"].toInteger(-1);
+        seg.pos = segObj["pos"].toInteger();
+        info.segments.append(seg);
+    }
+
+    // Sidecars written before segmenting describe a single stream
+    if (info.segments.isEmpty()) {
+        Segment seg;
+        seg.end = info.total > 0 ? info.total - 1 : -1;
+        info.segments.append(seg);
+    }
+
+    return !info.url.isEmpty();
+}
+
+void DownloadEngine::writePartInfo(const QString& tempPath, const PartInfo& info)
+{
+    QJsonObject obj;
+    obj["url"] = info.url;
+    obj["etag"] = QString::fromUtf8(info.etag);
+    obj["last_modified"] = QString::fromUtf8(info.lastModified);
+    obj["total"] = info.total;
+    obj["preallocated"] = info.preallocated;
+
+    QJsonArray segments;
+    for (const auto& seg : info.segments) {
+        QJsonObject segObj;
+        segObj["start"] = seg.start;
+        segObj["end"] = seg.end;
+        segObj["pos"] = seg.pos;
+        segments.append(segObj);
+    }
+    obj["segments"] = segments;
+
+    QFile file(partInfoPath(tempPath));
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(QJsonDocument(obj).toJson(QJsonDocument::Compact));
+    }
+}
+
+void DownloadEngine::removePartial(const QString& tempPath)
+{
+    QFile::remove(tempPath);
+    QFile::remove(partInfoPath(tempPath));
+}
@@ -0,0 +1,326 @@
+#pragma once
+
+#include <QObject>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QFile>
+#include <QProcess>
+#include <QMap>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <QMutex>
+#include <atomic>
+#include <memory>
+#include "contenthash.h"
+
+struct DownloadProgress {
+    int mediaId = 0;
+    qint64 received = 0;
+    qint64 total = -1;
+};
+Q_DECLARE_METATYPE(DownloadProgress)
+
+// Transfer engine. Runs on the download thread owned by DownloadManager and is only
+// driven through queued calls; nothing here touches Settings or widgets.
+class DownloadEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DownloadEngine(QObject* parent = nullptr);
+    ~DownloadEngine();
+
+    // Queued tasks start by class, then smallest expected size first
+    enum Priority { Interactive, Normal, Background };
+    Q_ENUM(Priority)
+
+    // A non-empty storeKey lets the media store satisfy the request without the network
+    Q_INVOKABLE void downloadMedia(int mediaId, const QUrl& url, const QString& destPath,
+                                   DownloadEngine::Priority priority, qint64 expectedBytes,
+                                   const QString& storeKey);
+    Q_INVOKABLE void cancelAll();
+
+    // Opens TLS connections on the download thread's manager ahead of the first download
+    Q_INVOKABLE void warmUp(const QStringList& hosts);
+
+    // Streams the response body into ffmpeg's stdin instead of a file. ffmpegArgs must
+    // read from pipe:0 and write partialOutputPath() of each of outputPaths; they are
+    // renamed once ffmpeg exits cleanly. A non-empty rawPath also keeps the raw file.
+    Q_INVOKABLE void ingestMedia(int mediaId, const QUrl& url, const QStringList& ffmpegArgs,
+                                 const QStringList& outputPaths, const QString& rawPath,
+                                 DownloadEngine::Priority priority, qint64 expectedBytes);
+
+    // Where ffmpeg writes an ingest output until it is complete. The extension is kept
+    // so ffmpeg still picks the muxer from it: clip.mp4 -> clip.part.mp4
+    static QString partialOutputPath(const QString& path);
+
+    // Each streamed ingest runs an ffmpeg encode; at most this many run at once so they
+    // stay within the scale CPU budget. Plain downloads are not affected.
+    Q_INVOKABLE void setIngestLimit(int maxStreams);
+
+    // Moves a queued task to the front; no effect once it has started
+    Q_INVOKABLE void boost(int mediaId);
+
+    // Lets idle connections take over half of a straggling segment once the queue is empty
+    Q_INVOKABLE void setHedgingEnabled(bool enabled);
+
+    // While paused no queued task is started; running transfers finish normally
+    Q_INVOKABLE void setPaused(bool paused);
+
+    bool isDownloading() const { return !m_transfers.isEmpty() || !m_streams.isEmpty() || !m_queue.isEmpty(); }
+    int pendingCount() const { return m_queue.size() + m_transfers.size() + m_streams.size(); }
+
+    // Active transfers adapt between the bounds from measured throughput and errors
+    Q_INVOKABLE void setConcurrencyBounds(int minimum, int maximum);
+    int concurrencyWindow() const { return m_window; }
+    int activeRequests() const { return m_requests.size() + m_streams.size(); }
+    double throughput() const { return m_throughput; }  // Bytes per second, smoothed
+
+    static const int INITIAL_CONCURRENT_DOWNLOADS = 8;
+    static const int CONTROL_INTERVAL_MS = 2000;
+
+    // Unread data per reply is capped so pacing reads pushes back on the TCP window
+    static const qint64 READ_BUFFER_SIZE = 256 * 1024;
+    static const int PACING_INTERVAL_MS = 50;
+
+    // Unconsumed data allowed in ffmpeg's stdin before a stream stops reading the socket
+    static const qint64 INGEST_PIPE_LIMIT = 4 * 1024 * 1024;
+
+    // Progress is coalesced per file and handed to the UI at most this often
+    static const int PROGRESS_INTERVAL_MS = 100;
+
+    // Received data is gathered into aligned blocks and written by a single writer thread
+    static const qint64 WRITE_BLOCK_SIZE = 1024 * 1024;
+    static const int MAX_PENDING_BLOCKS = 32;
+    static const qint64 SAVE_PROGRESS_INTERVAL = 8 * 1024 * 1024;
+
+    struct WriteStats {
+        qint64 writeCalls = 0;
+        qint64 bytesWritten = 0;
+    };
+    WriteStats writeStats() const;
+
+    // Transient failures (transport errors, stalls, 408/429/5xx) are retried with
+    // jittered exponential backoff before the item is reported as failed
+    static const int MAX_RETRIES = 5;
+    static const int RETRY_BASE_DELAY_MS = 1000;
+    static const int RETRY_MAX_DELAY_MS = 60000;
+    static const int STALL_TIMEOUT_MS = 30000;
+
+    // A host with this many consecutive failures gets no requests for a while;
+    // after that a single probe request decides whether it is back
+    static const int CIRCUIT_FAILURE_THRESHOLD = 5;
+    static const int CIRCUIT_OPEN_MS = 30000;
+    static const int CIRCUIT_MAX_OPEN_MS = 600000;
+
+    // Smallest half a straggling segment is split into for hedging
+    static const qint64 HEDGE_MIN_BYTES = 2 * 1024 * 1024;
+
+    // Files at least this large are fetched as parallel byte-range segments
+    static const qint64 MIN_SEGMENTED_SIZE = 32 * 1024 * 1024;
+    static const qint64 SEGMENT_SIZE = 16 * 1024 * 1024;
+
+signals:
+    void downloadStarted(int mediaId);
+    void progressBatch(const QList<DownloadProgress>& progress);
+    void downloadCompleted(int mediaId, const QString& path);
+    // Emitted just before downloadCompleted with the byte count and XXH64 of the file
+    void downloadVerified(int mediaId, qint64 bytes, const QString& hash);
+    void downloadError(int mediaId, const QString& error);
+    // A streamed ingest finished; rawPath is empty unless the raw file was kept
+    void ingestCompleted(int mediaId, const QString& outputPath, const QString& rawPath);
+    void allDownloadsCompleted();
+    void transferStatsChanged(int window, int active, double bytesPerSecond);
+
+private slots:
+    void onRequestFinished();
+    void onControlTick();
+    void onPacingTick();
+    void flushProgress();
+
+private:
+    void startDownloads();
+
+    struct DownloadTask {
+        int mediaId;
+        QUrl url;
+        QString destPath;
+        Priority priority = Normal;
+        qint64 expectedBytes = -1;  // Unknown sizes sort after known ones
+        quint64 sequence = 0;       // Submission order breaks ties
+        quint64 boost = 0;          // Boosted tasks run first, the latest boost ahead
+        QString storeKey;
+
+        // Streamed ingest: destPath is ffmpeg's first output, rawPath the optional tee
+        QStringList ffmpegArgs;
+        QStringList outputPaths;
+        QString rawPath;
+    };
+
+    static bool runsBefore(const DownloadTask& a, const DownloadTask& b);
+
+    // A byte range of the destination file. end is inclusive and -1 while the length is unknown.
+    struct Segment {
+        qint64 start = 0;
+        qint64 end = -1;
+        qint64 pos = 0;  // Next byte to write
+        bool requested = false;
+        qint64 retryAt = 0;  // Engine clock time before which it is not requested again
+
+        bool isDone() const { return end >= 0 && pos > end; }
+    };
+
+    // Resume state kept next to <dest>.part in <dest>.part.json
+    struct PartInfo {
+        QString url;
+        QByteArray etag;
+        QByteArray lastModified;
+        qint64 total = -1;
+        bool preallocated = false;
+        QList<Segment> segments;
+
+        QByteArray validator() const { return etag.isEmpty() ? lastModified : etag; }
+    };
+
+    // One destination file, fetched by one or more segment requests
+    // Content hash advanced on the writer thread. Blocks that continue the hashed prefix
+    // are hashed from memory; ranges written ahead of it wait in written until the prefix
+    // reaches them and are then read back while still in the page cache.
+    struct HashState {
+        ContentHash hasher;
+        qint64 hashedUpTo = 0;
+        QMap<qint64, qint64> written;  // On disk past hashedUpTo: start -> end (exclusive)
+    };
+
+    struct Transfer {
+        DownloadTask task;
+        QFile* file = nullptr;
+        PartInfo part;
+        QUrl resolvedUrl;  // After redirects; used for the extra segment requests
+        int activeRequests = 0;
+        qint64 bytesSinceSave = 0;
+        std::shared_ptr<HashState> hash;
+        int failures = 0;  // Consecutive failed requests without progress
+    };
+
+    struct SegmentRequest {
+        int transferId = 0;
+        int segment = 0;
+        bool headersHandled = false;
+        bool acceptBody = false;
+        bool complete = false;  // Segment filled, reply aborted on purpose
+        bool stalled = false;   // Aborted by the stall check
+        QString host;
+        qint64 startPos = 0;
+        qint64 lastActivity = 0;
+
+        QByteArray buffer;        // Pooled block being filled
+        qint64 bufferOffset = 0;  // File offset of buffer[0]
+        qint64 fill = 0;
+    };
+
+    struct HostCircuit {
+        int failures = 0;
+        bool open = false;
+        bool probing = false;  // Half-open: one request is testing the host
+        qint64 openUntil = 0;
+        qint64 openMs = CIRCUIT_OPEN_MS;
+    };
+
+    // One response piped into an ffmpeg process
+    struct IngestStream {
+        DownloadTask task;
+        QProcess* ffmpeg = nullptr;
+        QFile* tee = nullptr;
+        ContentHash hasher;
+        qint64 received = 0;
+        qint64 total = -1;
+        bool headersChecked = false;
+        bool networkDone = false;
+        QString error;
+        QByteArray stderrTail;  // Last UploadManager::STDERR_TAIL_BYTES of ffmpeg's log
+    };
+
+    void startTask(const DownloadTask& task);
+    void startIngest(const DownloadTask& task);
+    void pumpIngest(QNetworkReply* reply);
+    void onIngestReplyFinished(QNetworkReply* reply);
+    void onIngestProcessFinished(QNetworkReply* reply, int exitCode, QProcess::ExitStatus status);
+    void failIngest(QNetworkReply* reply, const QString& error);
+    void removeIngest(QNetworkReply* reply);
+    int activeCount() const { return m_requests.size() + m_streams.size(); }
+    bool startPendingSegment(bool idleTransfersOnly);
+    bool hedgeStraggler();
+    void resetTransfer(Transfer& transfer);
+    void scheduleRetry(int transferId, int segment, bool resumable, int retryAfterSeconds);
+    void scheduleWakeup();
+    void scheduleStart();
+    bool hasTaskFor(const QString& destPath) const;
+    void checkStalledRequests();
+    bool hostAvailable(const QString& host) const;
+    void recordHostResult(const QString& host, bool success);
+    void sendSegmentRequest(int transferId, int segment);
+    bool handleResponseHeaders(QNetworkReply* reply, SegmentRequest& request);
+    void writeSegmentData(QNetworkReply* reply);
+    void splitSegment(Transfer& transfer, int segment);
+    void finishTransfer(int transferId);
+    void failTransfer(int transferId, const QString& error, bool keepPartial);
+    void abortRequests(int transferId, QNetworkReply* except = nullptr);
+    void queueProgress(const Transfer& transfer);
+    void submitBuffer(Transfer& transfer, SegmentRequest& request);
+    void saveProgress(int transferId);
+    bool completeHash(Transfer& transfer, quint64& hash);
+    QByteArray acquireBuffer();
+    void releaseBuffer(QByteArray buffer);
+    static void markWritten(HashState& state, qint64 start, qint64 end);
+    void advanceHash(QFile* file, HashState& state);
+
+    static QString partInfoPath(const QString& tempPath);
+    static bool readPartInfo(const QString& tempPath, PartInfo& info);
+    static void writePartInfo(const QString& tempPath, const PartInfo& info);
+    static void removePartial(const QString& tempPath);
+
+    QNetworkAccessManager m_network;
+    QMap<int, Transfer> m_transfers;
+    QMap<QNetworkReply*, SegmentRequest> m_requests;
+    QMap<QNetworkReply*, IngestStream> m_streams;
+    QList<DownloadTask> m_queue;  // Kept sorted by runsBefore()
+    quint64 m_nextSequence = 0;
+    quint64 m_nextBoost = 1;
+    bool m_startScheduled = false;
+    int m_nextTransferId = 1;
+
+    QTimer m_pacingTimer;
+    QTimer m_progressTimer;
+    QTimer m_wakeupTimer;  // Fires when a backoff or an open circuit expires
+    QElapsedTimer m_clock;
+    QMap<QString, HostCircuit> m_circuits;
+    bool m_hedging = true;
+    bool m_paused = false;
+    int m_maxIngests = 1;
+    QMap<int, DownloadProgress> m_pendingProgress;
+
+    // Concurrency control (AIMD with a throughput-gradient gate on increases)
+    QTimer m_controlTimer;
+    QElapsedTimer m_intervalClock;
+    int m_window = INITIAL_CONCURRENT_DOWNLOADS;
+    int m_minWindow = 2;
+    int m_maxWindow = 16;
+    qint64 m_intervalBytes = 0;
+    int m_intervalErrors = 0;
+    double m_throughput = 0.0;
+    double m_probeBaseline = 0.0;  // Throughput before the last increase
+    bool m_probing = false;
+    int m_holdTicks = 0;
+
+    // Block writer
+    QMutex m_bufferMutex;
+    QList<QByteArray> m_freeBuffers;
+    std::atomic<int> m_pendingBlocks{0};
+    std::atomic<qint64> m_writeCalls{0};
+    std::atomic<qint64> m_bytesWritten{0};
+
+    // Declared last so it is destroyed (and drained) before the state its tasks use
+    QThreadPool m_writePool;
+};
@@ -1,144 +1,243 @@
 #include "downloadmanager.h"
-#include <QFileInfo>
-#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QDebug>
 
 DownloadManager::DownloadManager(QObject* parent)
     : QObject(parent)
 {
+    qRegisterMetaType<DownloadProgress>();
+    qRegisterMetaType<QList<DownloadProgress>>();
+    qRegisterMetaType<DownloadEngine::Priority>();
+
+    m_journalTimer.setSingleShot(true);
+    m_journalTimer.setInterval(1000);
+    connect(&m_journalTimer, &QTimer::timeout, this, &DownloadManager::saveJournal);
+
+    m_engine = new DownloadEngine();
+    m_engine->moveToThread(&m_thread);
+    connect(&m_thread, &QThread::finished, m_engine, &QObject::deleteLater);
+
+    connect(m_engine, &DownloadEngine::downloadStarted, this, &DownloadManager::downloadStarted);
+    connect(m_engine, &DownloadEngine::progressBatch, this, [this](const QList<DownloadProgress>& progress) {
+        for (const auto& entry : progress) {
+            auto it = m_journal.find(entry.mediaId);
+            if (it != m_journal.end()) {
+                it->received = entry.received;
+                touchJournal();
+            }
+            emit downloadProgress(entry.mediaId, entry.received, entry.total);
+        }
+    });
+    connect(m_engine, &DownloadEngine::downloadCompleted, this, [this](int mediaId, const QString& path) {
+        finishItem(mediaId);
+        emit downloadCompleted(mediaId, path);
+    });
+    connect(m_engine, &DownloadEngine::downloadVerified, this, &DownloadManager::downloadVerified);
+    connect(m_engine, &DownloadEngine::downloadError, this, [this](int mediaId, const QString& error) {
+        finishItem(mediaId);
+        emit downloadError(mediaId, error);
+    });
+    connect(m_engine, &DownloadEngine::ingestCompleted, this, [this](int mediaId, const QString& outputPath, const QString& rawPath) {
+        finishItem(mediaId);
+        emit ingestCompleted(mediaId, outputPath, rawPath);
+    });
+    connect(m_engine, &DownloadEngine::allDownloadsCompleted, this, [this]() {
+        // The engine can run dry while later requests of a batch are still on their way
+        // to its thread; only the per-item results above settle the count
+        if (m_pending == 0) {
+            emit allDownloadsCompleted();
+        }
+    });
+    connect(m_engine, &DownloadEngine::transferStatsChanged, this, [this](int window, int active, double bytesPerSecond) {
+        m_window = window;
+        m_activeRequests = active;
+        m_throughput = bytesPerSecond;
+        emit transferStatsChanged(window, active, bytesPerSecond);
+    });
+
+    m_thread.setObjectName("DownloadEngine");
+    m_thread.start();
 }
 
-void DownloadManager::downloadMedia(int mediaId, const QUrl& url, const QString& destPath)
+DownloadManager::~DownloadManager()
 {
-    DownloadTask task;
-    task.mediaId = mediaId;
-    task.url = url;
-    task.destPath = destPath;
+    // The journal is kept: whatever is still listed resumes on the next start
+    saveJournal();
 
-    m_queue.enqueue(task);
-    startDownloads();
+    // Let the engine flush buffered data and resume info before the thread goes away
+    QMetaObject::invokeMethod(m_engine, "cancelAll", Qt::BlockingQueuedConnection);
+    m_thread.quit();
+    m_thread.wait();
 }
 
-void DownloadManager::cancelAll()
+void DownloadManager::downloadMedia(int mediaId, const QUrl& url, const QString& destPath,
+                                    DownloadEngine::Priority priority, qint64 expectedBytes,
+                                    const QString& storeKey)
 {
-    m_queue.clear();
-
-    for (auto reply : m_activeDownloads.keys()) {
-        ActiveDownload& download = m_activeDownloads[reply];
-        reply->abort();
-        reply->deleteLater();
-        if (download.file) {
-            download.file->close();
-            download.file->remove();
-            delete download.file;
-        }
+    if (m_queuedIds.contains(mediaId)) {
+        qDebug() << "Download of" << mediaId << "is already queued";
+        return;
     }
-    m_activeDownloads.clear();
+    m_queuedIds.insert(mediaId);
+
+    QueuedDownload entry;
+    entry.mediaId = mediaId;
+    entry.url = url;
+    entry.destPath = destPath;
+    entry.priority = priority;
+    entry.expectedBytes = expectedBytes;
+    entry.storeKey = storeKey;
+    m_journal[mediaId] = entry;
+    touchJournal();
+
+    m_pending++;
+    QMetaObject::invokeMethod(m_engine, "downloadMedia", Qt::QueuedConnection,
+                              Q_ARG(int, mediaId), Q_ARG(QUrl, url), Q_ARG(QString, destPath),
+                              Q_ARG(DownloadEngine::Priority, priority), Q_ARG(qint64, expectedBytes),
+                              Q_ARG(QString, storeKey));
 }
 
-void DownloadManager::startDownloads()
+void DownloadManager::ingestMedia(int mediaId, const QUrl& url, const QStringList& ffmpegArgs,
+                                  const QStringList& outputPaths, const QString& rawPath,
+                                  DownloadEngine::Priority priority, qint64 expectedBytes)
 {
-    while (m_activeDownloads.size() < MAX_CONCURRENT_DOWNLOADS && !m_queue.isEmpty()) {
-        DownloadTask task = m_queue.dequeue();
-
-        // Ensure directory exists
-        QFileInfo info(task.destPath);
-        QDir dir = info.absoluteDir();
-        if (!dir.exists()) {
-            dir.mkpath(".");
-        }
-
-        // Check if file already exists
-        if (QFile::exists(task.destPath)) {
-            emit downloadCompleted(task.mediaId, task.destPath);
-            continue;  // Try next in queue
-        }
+    if (m_queuedIds.contains(mediaId)) {
+        qDebug() << "Download of" << mediaId << "is already queued";
+        return;
+    }
+    m_queuedIds.insert(mediaId);
 
-        // Create temp file
-        QString tempPath = task.destPath + ".part";
-        QFile* file = new QFile(tempPath);
-        if (!file->open(QIODevice::WriteOnly)) {
-            emit downloadError(task.mediaId,
-                QString("Cannot create file: %1").arg(tempPath));
-            delete file;
-            continue;  // Try next in queue
-        }
+    m_pending++;
+    QMetaObject::invokeMethod(m_engine, "ingestMedia", Qt::QueuedConnection,
+                              Q_ARG(int, mediaId), Q_ARG(QUrl, url), Q_ARG(QStringList, ffmpegArgs),
+                              Q_ARG(QStringList, outputPaths), Q_ARG(QString, rawPath),
+                              Q_ARG(DownloadEngine::Priority, priority), Q_ARG(qint64, expectedBytes));
+}
 
-        emit downloadStarted(task.mediaId);
+void DownloadManager::warmUp(const QStringList& hosts)
+{
+    QMetaObject::invokeMethod(m_engine, "warmUp", Qt::QueuedConnection, Q_ARG(QStringList, hosts));
+}
 
-        QNetworkRequest request(task.url);
-        request.setRawHeader("User-Agent", "PexelManager/1.0");
+void DownloadManager::boost(int mediaId)
+{
+    QMetaObject::invokeMethod(m_engine, "boost", Qt::QueuedConnection, Q_ARG(int, mediaId));
+}
 
-        QNetworkReply* reply = m_network.get(request);
+void DownloadManager::cancelAll()
+{
+    m_pending = 0;
+    m_queuedIds.clear();
+    QMetaObject::invokeMethod(m_engine, "cancelAll", Qt::QueuedConnection);
 
-        ActiveDownload download;
-        download.task = task;
-        download.file = file;
-        m_activeDownloads[reply] = download;
+    // Cancelled on purpose, so nothing to resume; partial files stay for a later attempt
+    m_journal.clear();
+    saveJournal();
+}
 
-        connect(reply, &QNetworkReply::downloadProgress,
-                this, &DownloadManager::onDownloadProgress);
-        connect(reply, &QNetworkReply::finished,
-                this, &DownloadManager::onDownloadFinished);
-        connect(reply, &QNetworkReply::readyRead, this, [this, reply]() {
-            if (m_activeDownloads.contains(reply)) {
-                ActiveDownload& download = m_activeDownloads[reply];
-                if (download.file) {
-                    download.file->write(reply->readAll());
-                }
-            }
-        });
+QList<QueuedDownload> DownloadManager::openJournal(const QString& path)
+{
+    saveJournal();
+    m_journal.clear();
+    m_journalPath = path;
+
+    QList<QueuedDownload> entries;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return entries;
+
+    QJsonArray array = QJsonDocument::fromJson(file.readAll()).array();
+    for (const auto& value : array) {
+        QJsonObject json = value.toObject();
+        QueuedDownload entry;
+        entry.mediaId = json["media_id"].toInt();
+        entry.url = QUrl(json["url"].toString());
+        entry.destPath = json["dest_path"].toString();
+        entry.priority = static_cast<DownloadEngine::Priority>(json["priority"].toInt(DownloadEngine::Normal));
+        entry.expectedBytes = json["expected_bytes"].toInteger(-1);
+        entry.storeKey = json["store_key"].toString();
+        entry.received = json["received"].toInteger();
+        if (entry.mediaId != 0 && entry.url.isValid()) {
+            entries.append(entry);
+        }
     }
 
-    // Check if all done
-    if (m_activeDownloads.isEmpty() && m_queue.isEmpty()) {
-        emit allDownloadsCompleted();
-    }
+    qDebug() << "Download journal" << path << "lists" << entries.size() << "unfinished downloads";
+    return entries;
 }
 
-void DownloadManager::onDownloadProgress(qint64 received, qint64 total)
+void DownloadManager::finishItem(int mediaId)
 {
-    auto reply = qobject_cast<QNetworkReply*>(sender());
-    if (!reply || !m_activeDownloads.contains(reply)) return;
+    m_pending = qMax(0, m_pending - 1);
+    m_queuedIds.remove(mediaId);
+    finishJournalEntry(mediaId);
+}
 
-    emit downloadProgress(m_activeDownloads[reply].task.mediaId, received, total);
+void DownloadManager::finishJournalEntry(int mediaId)
+{
+    if (m_journal.remove(mediaId) > 0) {
+        touchJournal();
+    }
 }
 
-void DownloadManager::onDownloadFinished()
+void DownloadManager::touchJournal()
 {
-    auto reply = qobject_cast<QNetworkReply*>(sender());
-    if (!reply || !m_activeDownloads.contains(reply)) return;
+    if (!m_journalTimer.isActive()) {
+        m_journalTimer.start();
+    }
+}
 
-    ActiveDownload download = m_activeDownloads.take(reply);
+void DownloadManager::saveJournal()
+{
+    m_journalTimer.stop();
+    if (m_journalPath.isEmpty()) return;
 
-    // Write any remaining data
-    if (download.file) {
-        download.file->write(reply->readAll());
-        download.file->close();
+    if (m_journal.isEmpty()) {
+        QFile::remove(m_journalPath);
+        return;
     }
 
-    QString tempPath = download.file ? download.file->fileName() : QString();
-    delete download.file;
+    QJsonArray array;
+    for (const auto& entry : m_journal) {
+        QJsonObject json;
+        json["media_id"] = entry.mediaId;
+        json["url"] = entry.url.toString();
+        json["dest_path"] = entry.destPath;
+        json["part_path"] = entry.destPath + ".part";
+        json["priority"] = static_cast<int>(entry.priority);
+        json["expected_bytes"] = entry.expectedBytes;
+        json["store_key"] = entry.storeKey;
+        json["received"] = entry.received;
+        array.append(json);
+    }
 
-    if (reply->error() != QNetworkReply::NoError) {
-        if (!tempPath.isEmpty()) {
-            QFile::remove(tempPath);
-        }
-        if (reply->error() != QNetworkReply::OperationCanceledError) {
-            emit downloadError(download.task.mediaId,
-                QString("Download failed: %1").arg(reply->errorString()));
-        }
-    } else {
-        // Rename temp file to final
-        QFile::remove(download.task.destPath);  // Remove if exists
-        if (QFile::rename(tempPath, download.task.destPath)) {
-            emit downloadCompleted(download.task.mediaId, download.task.destPath);
-        } else {
-            emit downloadError(download.task.mediaId, "Failed to rename downloaded file");
-        }
+    QSaveFile file(m_journalPath);
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(QJsonDocument(array).toJson());
+        file.commit();
     }
+}
 
-    reply->deleteLater();
+void DownloadManager::setHedgingEnabled(bool enabled)
+{
+    QMetaObject::invokeMethod(m_engine, "setHedgingEnabled", Qt::QueuedConnection, Q_ARG(bool, enabled));
+}
 
-    // Start more downloads if available
-    startDownloads();
+void DownloadManager::setIngestLimit(int maxStreams)
+{
+    QMetaObject::invokeMethod(m_engine, "setIngestLimit", Qt::QueuedConnection, Q_ARG(int, maxStreams));
+}
+
+void DownloadManager::setPaused(bool paused)
+{
+    QMetaObject::invokeMethod(m_engine, "setPaused", Qt::QueuedConnection, Q_ARG(bool, paused));
+}
+
+void DownloadManager::setConcurrencyBounds(int minimum, int maximum)
+{
+    QMetaObject::invokeMethod(m_engine, "setConcurrencyBounds", Qt::QueuedConnection,
+                              Q_ARG(int, minimum), Q_ARG(int, maximum));
 }
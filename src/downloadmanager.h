@@ -1,53 +1,98 @@
 #pragma once
 
+#include "downloadengine.h"
 #include <QObject>
-#include <QNetworkAccessManager>
-#include <QNetworkReply>
-#include <QQueue>
-#include <QFile>
+#include <QThread>
+#include <QTimer>
+#include <QUrl>
 #include <QMap>
+#include <QSet>
 
+// A download as recorded in the per-project queue journal
+struct QueuedDownload {
+    int mediaId = 0;
+    QUrl url;
+    QString destPath;
+    DownloadEngine::Priority priority = DownloadEngine::Normal;
+    qint64 expectedBytes = -1;
+    QString storeKey;
+    qint64 received = 0;  // Last reported progress; the .part sidecar has the exact ranges
+};
+
+// GUI-thread front end for DownloadEngine. The engine, its network access manager and
+// its file writes live on a dedicated thread; this class forwards requests as queued
+// calls and re-emits the engine's batched status on the GUI thread.
 class DownloadManager : public QObject
 {
     Q_OBJECT
 
 public:
     explicit DownloadManager(QObject* parent = nullptr);
+    ~DownloadManager();
 
-    void downloadMedia(int mediaId, const QUrl& url, const QString& destPath);
+    void downloadMedia(int mediaId, const QUrl& url, const QString& destPath,
+                       DownloadEngine::Priority priority = DownloadEngine::Normal, qint64 expectedBytes = -1,
+                       const QString& storeKey = QString());
     void cancelAll();
 
-    bool isDownloading() const { return !m_activeDownloads.isEmpty() || !m_queue.isEmpty(); }
-    int pendingCount() const { return m_queue.size() + m_activeDownloads.size(); }
+    // Pipes the download through ffmpeg; see DownloadEngine::ingestMedia. Streams are
+    // not journaled since they cannot resume.
+    void ingestMedia(int mediaId, const QUrl& url, const QStringList& ffmpegArgs, const QStringList& outputPaths,
+                     const QString& rawPath = QString(), DownloadEngine::Priority priority = DownloadEngine::Normal,
+                     qint64 expectedBytes = -1);
+
+    void warmUp(const QStringList& hosts);
+
+    // Start this item next if it is still waiting, e.g. because the user selected it
+    void boost(int mediaId);
+
+    // Downloads and ingests of an item already queued or running are ignored, so a
+    // resumed journal and a new selection never fetch the same file twice
+    bool isQueued(int mediaId) const { return m_queuedIds.contains(mediaId); }
+
+    bool isDownloading() const { return m_pending > 0; }
+    int pendingCount() const { return m_pending; }
 
-    static const int MAX_CONCURRENT_DOWNLOADS = 8;
+    void setConcurrencyBounds(int minimum, int maximum);
+    void setHedgingEnabled(bool enabled);
+    void setIngestLimit(int maxStreams);
+    void setPaused(bool paused);
+
+    // Unfinished downloads are journaled to path so a batch survives a restart.
+    // Switches to the new journal and returns the downloads it still lists.
+    QList<QueuedDownload> openJournal(const QString& path);
+    int concurrencyWindow() const { return m_window; }
+    int activeRequests() const { return m_activeRequests; }
+    double throughput() const { return m_throughput; }  // Bytes per second, smoothed
 
 signals:
     void downloadStarted(int mediaId);
     void downloadProgress(int mediaId, qint64 received, qint64 total);
     void downloadCompleted(int mediaId, const QString& path);
+    void downloadVerified(int mediaId, qint64 bytes, const QString& hash);
     void downloadError(int mediaId, const QString& error);
+    void ingestCompleted(int mediaId, const QString& outputPath, const QString& rawPath);
     void allDownloadsCompleted();
-
-private slots:
-    void onDownloadProgress(qint64 received, qint64 total);
-    void onDownloadFinished();
+    void transferStatsChanged(int window, int active, double bytesPerSecond);
 
 private:
-    void startDownloads();
-
-    struct DownloadTask {
-        int mediaId;
-        QUrl url;
-        QString destPath;
-    };
-
-    struct ActiveDownload {
-        DownloadTask task;
-        QFile* file;
-    };
-
-    QNetworkAccessManager m_network;
-    QMap<QNetworkReply*, ActiveDownload> m_activeDownloads;
-    QQueue<DownloadTask> m_queue;
+    void finishItem(int mediaId);
+    void finishJournalEntry(int mediaId);
+    void touchJournal();
+    void saveJournal();
+
+    QThread m_thread;
+    DownloadEngine* m_engine;
+
+    QString m_journalPath;
+    QMap<int, QueuedDownload> m_journal;
+    QTimer m_journalTimer;  // Coalesces journal writes
+
+    QSet<int> m_queuedIds;
+
+    // Last state reported by the engine
+    int m_pending = 0;
+    int m_window = DownloadEngine::INITIAL_CONCURRENT_DOWNLOADS;
+    int m_activeRequests = 0;
+    double m_throughput = 0.0;
 };
@@ -0,0 +1,68 @@
+#include "imagescaler.h"
+#include <QImage>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QFile>
+#include <QtMath>
+
+namespace {
+
+// Size to scale source to so that it covers width x height; cropping the center then
+// matches ffmpeg's scale=...:force_original_aspect_ratio=increase,crop=...
+QSize coveringSize(const QSize& source, int width, int height)
+{
+    double factor = qMax(double(width) / source.width(), double(height) / source.height());
+    return QSize(qMax(width, qCeil(source.width() * factor)),
+                 qMax(height, qCeil(source.height() * factor)));
+}
+
+}
+
+QString ImageScaler::scale(const QString& inputPath, const QList<Output>& outputs, int quality)
+{
+    QImageReader reader(inputPath);
+    QSize source = reader.size();
+    if (!source.isValid()) {
+        return QString("Cannot read %1: %2").arg(inputPath, reader.errorString());
+    }
+
+    // One decode serves every output, so it has to cover the largest
+    QSize decoded;
+    for (const auto& output : outputs) {
+        decoded = decoded.expandedTo(coveringSize(source, output.width, output.height));
+    }
+
+    // The JPEG handler decodes at 1/2, 1/4 or 1/8 size and smooth-scales the rest of the way,
+    // so a 6000px photo never exists at full size in memory
+    if (reader.supportsOption(QImageIOHandler::ScaledSize)) {
+        reader.setScaledSize(decoded);
+    }
+
+    QImage image = reader.read();
+    if (image.isNull()) {
+        return QString("Cannot decode %1: %2").arg(inputPath, reader.errorString());
+    }
+
+    // JPEG has no alpha
+    if (image.hasAlphaChannel()) {
+        image = image.convertToFormat(QImage::Format_RGB32);
+    }
+
+    for (const auto& output : outputs) {
+        QSize covered = coveringSize(image.size(), output.width, output.height);
+        QImage scaled = image.size() == covered
+            ? image : image.scaled(covered, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        scaled = scaled.copy((covered.width() - output.width) / 2, (covered.height() - output.height) / 2,
+                             output.width, output.height);
+
+        QImageWriter writer(output.path, "jpeg");
+        writer.setQuality(quality);
+        writer.setOptimizedWrite(true);
+        if (!writer.write(scaled)) {
+            QString error = writer.errorString();
+            QFile::remove(output.path);
+            return QString("Cannot write %1: %2").arg(output.path, error);
+        }
+    }
+    return QString();
+}
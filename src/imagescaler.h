@@ -0,0 +1,21 @@
+#pragma once
+
+#include <QString>
+#include <QList>
+
+// In-process replacement for ffmpeg on photos: the same increase-then-crop geometry,
+// decoded at reduced size where the codec allows it (JPEG's DCT scaling) and resampled
+// with QImage's smooth scaler, which has SSE/AVX2/NEON paths. Thread-safe; run it off
+// the GUI thread.
+class ImageScaler
+{
+public:
+    struct Output {
+        QString path;
+        int width = 0;
+        int height = 0;
+    };
+
+    // Writes one JPEG per output from a single decode; returns an empty string or the error
+    static QString scale(const QString& inputPath, const QList<Output>& outputs, int quality);
+};
@@ -1,5 +1,8 @@
 #include "mainwindow.h"
 #include "settings.h"
+#include "bandwidthscheduler.h"
+#include "mediastore.h"
+#include "networkservice.h"
 
 #include <QDebug>
 #include <QMenuBar>
@@ -9,6 +12,7 @@
 #include <QHBoxLayout>
 #include <QFormLayout>
 #include <QGroupBox>
+#include <QCheckBox>
 #include <QMessageBox>
 #include <QInputDialog>
 #include <QDialog>
@@ -16,6 +20,13 @@
 #include <QFileDialog>
 #include <QCloseEvent>
 #include <QDesktopServices>
+#include <QLocale>
+#include <QImageReader>
+#include <QThread>
+#include <QTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
 
 MainWindow::MainWindow(QWidget* parent)
     : QMainWindow(parent)
@@ -27,6 +38,7 @@ MainWindow::MainWindow(QWidget* parent)
     m_projectManager = new ProjectManager(this);
     m_downloadManager = new DownloadManager(this);
     m_uploadManager = new UploadManager(this);
+    m_pipeline = new PipelineController(this);
 
     setupUi();
     setupMenus();
@@ -41,28 +53,117 @@ MainWindow::MainWindow(QWidget* parent)
     connect(m_mediaList, &MediaListWidget::mediaRejected, this, &MainWindow::onMediaRejected);
 
     // Download connections
+    connect(m_projectManager, &ProjectManager::projectLoaded, this, &MainWindow::resumeQueuedDownloads);
     connect(m_downloadManager, &DownloadManager::downloadCompleted, this, &MainWindow::onDownloadCompleted);
+    connect(m_downloadManager, &DownloadManager::ingestCompleted, this, &MainWindow::onIngestCompleted);
     connect(m_downloadManager, &DownloadManager::downloadProgress, this, [this](int, qint64 recv, qint64 total) {
         if (total > 0) {
             m_progressBar->setValue(static_cast<int>(recv * 100 / total));
         }
     });
+    connect(m_downloadManager, &DownloadManager::downloadVerified, this, [this](int id, qint64 bytes, const QString& hash) {
+        if (m_cdnSizedKeys.contains(id)) return;  // Not a raw file
+        for (auto& item : m_projectManager->project().media) {
+            if (item.id == id) {
+                item.rawHash = hash;
+                item.rawBytes = bytes;
+                break;
+            }
+        }
+    });
     connect(m_downloadManager, &DownloadManager::downloadError, this, [this](int id, const QString& error) {
+        m_cdnSizedKeys.remove(id);
+
+        // ffmpeg cannot read every file from a pipe (e.g. an mp4 with its index at the
+        // end), so a failed stream is retried as a normal download
+        if (m_ingestFallbacks.contains(id)) {
+            IngestFallback fallback = m_ingestFallbacks.take(id);
+            if (MediaMetadata* item = findProjectMedia(id)) {
+                qDebug() << "Streamed ingest of" << id << "failed:" << error << "- downloading instead";
+                item->localRawPath = m_projectManager->project().rawDir() + "/" + rawFileName(*item);
+                m_downloadManager->downloadMedia(id, fallback.url, item->localRawPath, fallback.priority,
+                                                 fallback.expectedBytes, fallback.storeKey);
+                return;
+            }
+        }
         m_statusLabel->setText(QString("Download error for %1: %2").arg(id).arg(error));
     });
     connect(m_downloadManager, &DownloadManager::allDownloadsCompleted, this, [this]() {
         m_projectManager->saveProject();
+        finishPipelineBatch();
+    });
+    connect(m_downloadManager, &DownloadManager::transferStatsChanged, this, [this](int window, int active, double bytesPerSecond) {
+        m_transferStatsLabel->setVisible(active > 0);
+        m_transferStatsLabel->setText(QString("%1/%2 connections, %3/s")
+            .arg(active)
+            .arg(window)
+            .arg(QLocale().formattedDataSize(static_cast<qint64>(bytesPerSecond))));
     });
+    connect(&NetworkService::instance(), &NetworkService::statsChanged, this, [this]() {
+        auto stats = NetworkService::instance().stats();
+        m_transferStatsLabel->setToolTip(QString("Requests: %1 (%2 on reused connections, %3 over HTTP/2)\n"
+                                                 "TLS handshakes: %4 (plus %5 warm-ups), queued: %6 (peak %7)")
+            .arg(stats.requests).arg(stats.reusedConnections()).arg(stats.http2Requests)
+            .arg(stats.handshakes).arg(stats.warmUps).arg(stats.queued).arg(stats.peakQueued));
+    });
+    m_downloadManager->setConcurrencyBounds(Settings::instance().downloadMinConcurrency(),
+                                            Settings::instance().downloadMaxConcurrency());
+    m_downloadManager->setHedgingEnabled(Settings::instance().downloadHedging());
+    BandwidthScheduler::instance().applySettings();
+    MediaStore::instance().collectGarbage();
+
+    // Connect to the Pexels hosts now so the first search and download skip the handshake
+    NetworkService::instance().warmUp(NetworkService::knownHosts());
+    m_downloadManager->warmUp({"videos.pexels.com", "images.pexels.com"});
 
     // Scale/Upload connections
+    connect(m_uploadManager, &UploadManager::bucketReconciled, this,
+            [this](const QString& bucket, const QList<S3Object>& objects, const QString& error) {
+        if (error.isEmpty()) {
+            applyBucketListing(bucket, objects);
+        } else {
+            m_statusLabel->setText(QString("Reconcile of %1 failed: %2").arg(bucket, error));
+        }
+    });
     connect(m_uploadManager, &UploadManager::scaleCompleted, this, &MainWindow::onScaleCompleted);
     connect(m_uploadManager, &UploadManager::uploadCompleted, this, &MainWindow::onUploadCompleted);
+    connect(m_uploadManager, &UploadManager::scaleProgress, this, [this](int id, const UploadManager::ScaleProgress& progress) {
+        m_scaleProgress[id] = progress;
+        updateScaleProgress();
+    });
     connect(m_uploadManager, &UploadManager::scaleError, this, [this](int id, const QString& error) {
+        m_scaleProgress.remove(id);
+        updateScaleProgress();
         m_statusLabel->setText(QString("Scale error for %1: %2").arg(id).arg(error));
+        m_pipeline->scaleDone(id);
+    });
+    connect(m_uploadManager, &UploadManager::tasksCancelled, this, [this]() {
+        m_renditionUploads.clear();
     });
     connect(m_uploadManager, &UploadManager::uploadError, this, [this](int id, const QString& error) {
         m_statusLabel->setText(QString("Upload error for %1: %2").arg(id).arg(error));
+        bool failed = true;
+        if (!finishRenditionUpload(id, failed)) return;
+        m_pipeline->uploadDone(id);
+    });
+
+    // Pipeline mode: download -> scale -> upload per item, with bounded stage queues
+    connect(m_pipeline, &PipelineController::startScale, this, [this](int id) {
+        MediaMetadata* item = findProjectMedia(id);
+        if (!item || !queueScale(*item)) {
+            m_pipeline->scaleDone(id);
+        }
+    });
+    connect(m_pipeline, &PipelineController::startUpload, this, [this](int id) {
+        MediaMetadata* item = findProjectMedia(id);
+        if (!item || !queueUpload(*item)) {
+            m_pipeline->uploadDone(id);
+        }
     });
+    connect(m_pipeline, &PipelineController::downloadsPausedChanged, m_downloadManager, &DownloadManager::setPaused);
+    connect(m_pipeline, &PipelineController::drained, this, &MainWindow::finishPipelineBatch);
+    applyScaleBudget();
+    m_pipeline->setEnabled(Settings::instance().pipelineMode());
     connect(m_uploadManager, &UploadManager::indexUploadCompleted, this, [this]() {
         m_statusLabel->setText("Upload completed (including index.json)");
     });
@@ -104,6 +205,19 @@ MainWindow::~MainWindow()
 {
     saveState();
     m_projectManager->saveProject();
+
+    auto stats = NetworkService::instance().stats();
+    qDebug() << "Network:" << stats.requests << "requests," << stats.reusedConnections() << "reused,"
+             << stats.http2Requests << "HTTP/2," << stats.handshakes << "TLS handshakes";
+
+    auto scaleStats = m_uploadManager->scaleStats();
+    if (scaleStats.frames > 0) {
+        qDebug() << "Scaling:" << scaleStats.frames << "frames," << scaleStats.framesPerCoreSecond() << "fps/core";
+    }
+    if (scaleStats.images > 0) {
+        qDebug() << "Scaling:" << scaleStats.images << "photos in-process,"
+                 << scaleStats.imageSeconds / scaleStats.images << "s each";
+    }
 }
 
 void MainWindow::setupUi()
@@ -229,6 +343,14 @@ void MainWindow::setupUi()
     m_progressBar->setVisible(false);
     toolbarLayout->addWidget(m_progressBar);
 
+    m_transferStatsLabel = new QLabel(this);
+    m_transferStatsLabel->setVisible(false);
+    toolbarLayout->addWidget(m_transferStatsLabel);
+
+    m_scaleProgressLabel = new QLabel(this);
+    m_scaleProgressLabel->setVisible(false);
+    toolbarLayout->addWidget(m_scaleProgressLabel);
+
     m_statusLabel = new QLabel("Ready", this);
     toolbarLayout->addWidget(m_statusLabel);
 
@@ -249,6 +371,8 @@ void MainWindow::setupMenus()
     fileMenu->addAction("&Delete Project...", this, &MainWindow::onDeleteProject);
     fileMenu->addSeparator();
     fileMenu->addAction("Upload &Catalog JSON...", this, &MainWindow::onUploadCatalog);
+    fileMenu->addAction("Reconcile with &Bucket", this, &MainWindow::onReconcileBucket);
+    fileMenu->addAction("Output Re&nditions...", this, &MainWindow::onEditRenditions);
     fileMenu->addSeparator();
     fileMenu->addAction("&Settings...", this, &MainWindow::onSettings);
     fileMenu->addSeparator();
@@ -458,6 +582,181 @@ void MainWindow::onDeleteProject()
     }
 }
 
+void MainWindow::onEditRenditions()
+{
+    if (!m_projectManager->hasProject()) {
+        QMessageBox::information(this, "No Project", "No project is currently open.");
+        return;
+    }
+
+    auto& project = m_projectManager->project();
+
+    QStringList lines;
+    for (const auto& rendition : project.renditions) {
+        QString line = QString("%1 %2x%3").arg(rendition.name).arg(rendition.width).arg(rendition.height);
+        if (rendition.crf > 0) {
+            line += QString(" %1").arg(rendition.crf);
+        }
+        lines << line;
+    }
+
+    bool ok = false;
+    QString text = QInputDialog::getMultiLineText(this, "Output Renditions",
+        "One rendition per line as \"name WIDTHxHEIGHT [crf]\", the primary first.\n"
+        "All are encoded from one decode of the source. Leave empty for the\n"
+        "single target size from the settings.",
+        lines.join('\n'), &ok);
+    if (!ok) return;
+
+    static const QRegularExpression pattern("^([A-Za-z0-9][A-Za-z0-9_-]*)\\s+(\\d+)x(\\d+)(?:\\s+(\\d+))?$");
+    QList<Rendition> renditions;
+    QSet<QString> names;
+    QSet<QString> outputs;  // Files are named by size and CRF, so those must differ too
+    for (const QString& entry : text.split('\n')) {
+        QString line = entry.trimmed();
+        if (line.isEmpty()) continue;
+
+        auto match = pattern.match(line);
+        if (!match.hasMatch() || names.contains(match.captured(1))) {
+            QMessageBox::warning(this, "Output Renditions", QString("Invalid or duplicate rendition: %1").arg(line));
+            return;
+        }
+
+        Rendition rendition;
+        rendition.name = match.captured(1);
+        rendition.width = match.captured(2).toInt();
+        rendition.height = match.captured(3).toInt();
+        rendition.crf = match.captured(4).toInt();
+
+        // yuv420p needs even dimensions
+        if (rendition.width < 2 || rendition.height < 2 || rendition.width % 2 || rendition.height % 2) {
+            QMessageBox::warning(this, "Output Renditions", QString("Width and height must be even: %1").arg(line));
+            return;
+        }
+
+        QString output = QString("%1x%2 %3").arg(rendition.width).arg(rendition.height)
+            .arg(rendition.crf > 0 ? rendition.crf : Settings::instance().ffmpegCrf());
+        if (outputs.contains(output)) {
+            QMessageBox::warning(this, "Output Renditions", QString("Same size and CRF as another rendition: %1").arg(line));
+            return;
+        }
+
+        outputs.insert(output);
+        names.insert(rendition.name);
+        renditions.append(rendition);
+    }
+
+    project.renditions = renditions;
+    m_projectManager->saveProject();
+    m_statusLabel->setText(renditions.isEmpty() ? QString("Scaling to the configured target size")
+                                                : QString("Scaling to %1 renditions").arg(renditions.size()));
+}
+
+void MainWindow::onReconcileBucket()
+{
+    QString bucket = m_projectManager->hasProject() ? m_projectManager->project().s3Bucket
+                                                    : Settings::instance().s3Bucket();
+    if (bucket.isEmpty()) {
+        QMessageBox::warning(this, "No S3 Bucket", "Please set an S3 bucket in settings.");
+        return;
+    }
+
+    m_statusLabel->setText(QString("Listing s3://%1...").arg(bucket));
+    m_uploadManager->reconcileBucket(bucket);
+}
+
+void MainWindow::applyBucketListing(const QString& bucket, const QList<S3Object>& objects)
+{
+    QMap<QString, qint64> remote;
+    for (const auto& object : objects) {
+        remote[object.key] = object.size;
+    }
+
+    int marked = 0;
+    QStringList missing;
+    QSet<QString> referenced;
+
+    bool projectInBucket = m_projectManager->hasProject() && m_projectManager->project().s3Bucket == bucket;
+    if (projectInBucket) {
+        auto& project = m_projectManager->project();
+        QList<Rendition> ladder = project.outputRenditions();
+        for (auto& item : project.media) {
+            if (item.isRejected || item.localScaledPath.isEmpty()) continue;
+
+            // Uploaded means every rendition is there; a local file of a different size means the object is stale
+            bool present = true;
+            QStringList absent;
+            for (const QString& path : item.scaledPaths(ladder)) {
+                QString key = "media/" + QFileInfo(path).fileName();
+                referenced.insert(key);
+
+                QFileInfo local(path);
+                if (!remote.contains(key) || (local.exists() && local.size() != remote.value(key))) {
+                    present = false;
+                    absent.append(key);
+                }
+            }
+            if (present == item.isUploaded) continue;
+
+            item.isUploaded = present;
+            if (present) {
+                marked++;
+            } else {
+                missing.append(absent);
+            }
+            m_projectManager->updateMedia(item);
+            m_mediaList->updateMediaStatus(item.id, &item);
+        }
+
+        if (!remote.contains(QString("catalogs/%1.json").arg(project.categoryId))) {
+            missing.append(QString("catalogs/%1.json").arg(project.categoryId));
+        }
+        m_projectManager->saveProject();
+    }
+
+    // Media is shared between categories, so an orphan is one no project refers to
+    for (const QString& path : ProjectManager::availableProjects()) {
+        if (projectInBucket && path == m_projectManager->project().path) continue;
+
+        QFile file(path + "/project.json");
+        if (!file.open(QIODevice::ReadOnly)) continue;
+        QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+        for (const auto& value : root["media"].toArray()) {
+            for (const QString& scaled : MediaMetadata::fromJson(value.toObject()).scaledPaths()) {
+                referenced.insert("media/" + QFileInfo(scaled).fileName());
+            }
+        }
+    }
+
+    QStringList orphans;
+    for (auto it = remote.constBegin(); it != remote.constEnd(); ++it) {
+        if (it.key().startsWith("media/") && !referenced.contains(it.key())) {
+            orphans.append(it.key());
+        }
+    }
+
+    qDebug() << "Reconciled" << bucket << ":" << objects.size() << "objects," << marked << "marked uploaded,"
+             << missing.size() << "missing," << orphans.size() << "orphans";
+    for (const QString& key : missing) {
+        qDebug() << "  missing:" << key;
+    }
+    for (const QString& key : orphans) {
+        qDebug() << "  orphan:" << key;
+    }
+
+    m_statusLabel->setText(QString("Reconciled s3://%1: %2 objects").arg(bucket).arg(objects.size()));
+
+    QString report = QString("s3://%1 holds %2 objects.\n\n").arg(bucket).arg(objects.size());
+    if (projectInBucket) {
+        report += QString("Marked uploaded: %1\nMissing from the bucket: %2\n").arg(marked).arg(missing.size());
+    }
+    report += QString("Orphaned media (no project refers to it): %1").arg(orphans.size());
+    if (!missing.isEmpty() || !orphans.isEmpty()) {
+        report += "\n\nThe keys are listed in the log.";
+    }
+    QMessageBox::information(this, "Reconcile with Bucket", report);
+}
+
 void MainWindow::onUploadCatalog()
 {
     if (!m_projectManager->hasProject()) {
@@ -498,7 +797,7 @@ void MainWindow::onUploadCatalog()
         QMessageBox::Yes);
 
     if (result == QMessageBox::Yes) {
-        m_uploadManager->uploadCatalogJson(project.s3Bucket, project.categoryId, project.media);
+        m_uploadManager->uploadCatalogJson(project.s3Bucket, project.categoryId, project.media, project.renditions);
         m_statusLabel->setText("Uploading catalog...");
     }
 }
@@ -534,6 +833,23 @@ void MainWindow::onSettings()
     bucketEdit->setText(Settings::instance().s3Bucket());
     layout->addRow("S3 Bucket:", bucketEdit);
 
+    auto s3EndpointEdit = new QLineEdit(&dialog);
+    s3EndpointEdit->setText(Settings::instance().s3Endpoint());
+    s3EndpointEdit->setPlaceholderText("AWS (or e.g. http://localhost:9000)");
+    layout->addRow("S3 Endpoint:", s3EndpointEdit);
+
+    auto nativeS3Check = new QCheckBox("Upload with the built-in S3 client instead of the aws CLI", &dialog);
+    nativeS3Check->setChecked(Settings::instance().nativeS3Client());
+    layout->addRow("S3 Client:", nativeS3Check);
+
+    auto uploadBatchCheck = new QCheckBox("Batch aws CLI uploads into one transfer", &dialog);
+    uploadBatchCheck->setChecked(Settings::instance().uploadBatching());
+    layout->addRow("", uploadBatchCheck);
+
+    auto skipUnchangedCheck = new QCheckBox("Skip uploads the bucket already has (upload manifest)", &dialog);
+    skipUnchangedCheck->setChecked(Settings::instance().skipUnchangedUploads());
+    layout->addRow("", skipUnchangedCheck);
+
     auto targetWidthSpin = new QSpinBox(&dialog);
     targetWidthSpin->setRange(640, 3840);
     targetWidthSpin->setValue(Settings::instance().targetWidth());
@@ -544,16 +860,116 @@ void MainWindow::onSettings()
     targetHeightSpin->setValue(Settings::instance().targetHeight());
     layout->addRow("Target Height:", targetHeightSpin);
 
+    auto minConcurrencySpin = new QSpinBox(&dialog);
+    minConcurrencySpin->setRange(1, 64);
+    minConcurrencySpin->setValue(Settings::instance().downloadMinConcurrency());
+    layout->addRow("Min Connections:", minConcurrencySpin);
+
+    auto maxConcurrencySpin = new QSpinBox(&dialog);
+    maxConcurrencySpin->setRange(1, 64);
+    maxConcurrencySpin->setValue(Settings::instance().downloadMaxConcurrency());
+    layout->addRow("Max Connections:", maxConcurrencySpin);
+
+    auto hedgingCheck = new QCheckBox("Split slow downloads onto idle connections", &dialog);
+    hedgingCheck->setChecked(Settings::instance().downloadHedging());
+    layout->addRow("", hedgingCheck);
+
+    auto pipelineCheck = new QCheckBox("Scale and upload each item as soon as it is downloaded", &dialog);
+    pipelineCheck->setChecked(Settings::instance().pipelineMode());
+    layout->addRow("Pipeline:", pipelineCheck);
+
+    auto streamIngestCheck = new QCheckBox("Scale videos while they download (no raw file)", &dialog);
+    streamIngestCheck->setChecked(Settings::instance().streamIngest());
+    layout->addRow("Stream Ingest:", streamIngestCheck);
+
+    auto keepRawCheck = new QCheckBox("Keep the raw file of streamed videos", &dialog);
+    keepRawCheck->setChecked(Settings::instance().ingestKeepRaw());
+    layout->addRow("", keepRawCheck);
+
+    // Bandwidth caps in KB/s, 0 = unlimited
+    QMap<QString, QSpinBox*> capSpins;
+    const QList<QPair<QString, QString>> caps = {
+        {"global", "Global Cap (KB/s):"},
+        {"bulk", "Download Cap (KB/s):"},
+        {"peak_bulk", "Peak Download Cap (KB/s):"},
+        {"preview", "Preview Reserve (KB/s):"},
+        {"thumbnail", "Thumbnail Reserve (KB/s):"},
+        {"api", "API Reserve (KB/s):"},
+    };
+    for (const auto& cap : caps) {
+        auto spin = new QSpinBox(&dialog);
+        spin->setRange(0, 10000000);
+        // Interactive classes are never throttled; without a reserve their measured rate is reserved
+        bool reserve = cap.second.contains("Reserve");
+        spin->setSpecialValueText(reserve ? "Measured" : "Unlimited");
+        spin->setValue(Settings::instance().bandwidthCapKBps(cap.first));
+        layout->addRow(cap.second, spin);
+        capSpins[cap.first] = spin;
+    }
+
+    auto peakHoursLayout = new QHBoxLayout;
+    auto peakStartSpin = new QSpinBox(&dialog);
+    peakStartSpin->setRange(0, 23);
+    peakStartSpin->setValue(Settings::instance().bandwidthPeakStartHour());
+    auto peakEndSpin = new QSpinBox(&dialog);
+    peakEndSpin->setRange(0, 23);
+    peakEndSpin->setValue(Settings::instance().bandwidthPeakEndHour());
+    peakHoursLayout->addWidget(peakStartSpin);
+    peakHoursLayout->addWidget(new QLabel("to", &dialog));
+    peakHoursLayout->addWidget(peakEndSpin);
+    layout->addRow("Peak Hours:", peakHoursLayout);
+
+    auto selectionCombo = new QComboBox(&dialog);
+    selectionCombo->addItem("Largest under max res", false);
+    selectionCombo->addItem("Smallest covering target", true);
+    selectionCombo->setCurrentIndex(Settings::instance().coverTargetSelection() ? 1 : 0);
+    layout->addRow("Source Selection:", selectionCombo);
+
+    auto headroomSpin = new QSpinBox(&dialog);
+    headroomSpin->setRange(0, 100);
+    headroomSpin->setSuffix("%");
+    headroomSpin->setValue(Settings::instance().coverHeadroomPercent());
+    layout->addRow("Cover Headroom:", headroomSpin);
+
     auto crfSpin = new QSpinBox(&dialog);
     crfSpin->setRange(15, 35);
     crfSpin->setValue(Settings::instance().ffmpegCrf());
     layout->addRow("FFmpeg CRF:", crfSpin);
 
+    auto cdnImagesCheck = new QCheckBox("Fetch photos at target size from CDN", &dialog);
+    cdnImagesCheck->setChecked(Settings::instance().cdnImageResize());
+    layout->addRow("Photo Ingest:", cdnImagesCheck);
+
+    auto verifyCdnCheck = new QCheckBox("Verify CDN photo dimensions", &dialog);
+    verifyCdnCheck->setChecked(Settings::instance().verifyCdnImages());
+    layout->addRow("", verifyCdnCheck);
+
+    auto nativeImageCheck = new QCheckBox("Scale photos in-process instead of with ffmpeg", &dialog);
+    nativeImageCheck->setChecked(Settings::instance().nativeImageScaler());
+    layout->addRow("", nativeImageCheck);
+
+    auto jpegQualitySpin = new QSpinBox(&dialog);
+    jpegQualitySpin->setRange(50, 100);
+    jpegQualitySpin->setValue(Settings::instance().jpegQuality());
+    layout->addRow("JPEG Quality:", jpegQualitySpin);
+
+    auto mediaStoreCheck = new QCheckBox("Share raw downloads between projects", &dialog);
+    mediaStoreCheck->setChecked(Settings::instance().useMediaStore());
+    layout->addRow("Media Store:", mediaStoreCheck);
+
     auto presetCombo = new QComboBox(&dialog);
     presetCombo->addItems({"ultrafast", "superfast", "veryfast", "faster", "fast", "medium", "slow", "slower", "veryslow"});
     presetCombo->setCurrentText(Settings::instance().ffmpegPreset());
     layout->addRow("FFmpeg Preset:", presetCombo);
 
+    auto cpuBudgetSpin = new QSpinBox(&dialog);
+    cpuBudgetSpin->setRange(10, 100);
+    cpuBudgetSpin->setSuffix("%");
+    cpuBudgetSpin->setValue(Settings::instance().scaleCpuBudgetPercent());
+    cpuBudgetSpin->setToolTip(QString("Share of the %1 CPU threads that scale jobs may use together")
+                                  .arg(QThread::idealThreadCount()));
+    layout->addRow("Scale CPU Budget:", cpuBudgetSpin);
+
     auto buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel, &dialog);
     connect(buttons, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
     connect(buttons, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
@@ -564,10 +980,38 @@ void MainWindow::onSettings()
         settings.setPexelsApiKey(apiKeyEdit->text());
         settings.setAwsProfile(awsProfileEdit->text());
         settings.setS3Bucket(bucketEdit->text());
+        settings.setS3Endpoint(s3EndpointEdit->text().trimmed());
+        settings.setNativeS3Client(nativeS3Check->isChecked());
+        settings.setUploadBatching(uploadBatchCheck->isChecked());
+        settings.setSkipUnchangedUploads(skipUnchangedCheck->isChecked());
         settings.setTargetWidth(targetWidthSpin->value());
         settings.setTargetHeight(targetHeightSpin->value());
+        settings.setDownloadMinConcurrency(minConcurrencySpin->value());
+        settings.setDownloadMaxConcurrency(maxConcurrencySpin->value());
+        m_downloadManager->setConcurrencyBounds(minConcurrencySpin->value(), maxConcurrencySpin->value());
+        settings.setDownloadHedging(hedgingCheck->isChecked());
+        m_downloadManager->setHedgingEnabled(hedgingCheck->isChecked());
+        settings.setPipelineMode(pipelineCheck->isChecked());
+        m_pipeline->setEnabled(pipelineCheck->isChecked());
+        settings.setStreamIngest(streamIngestCheck->isChecked());
+        settings.setIngestKeepRaw(keepRawCheck->isChecked());
+        for (auto it = capSpins.begin(); it != capSpins.end(); ++it) {
+            settings.setBandwidthCapKBps(it.key(), it.value()->value());
+        }
+        settings.setBandwidthPeakStartHour(peakStartSpin->value());
+        settings.setBandwidthPeakEndHour(peakEndSpin->value());
+        BandwidthScheduler::instance().applySettings();
+        settings.setCoverTargetSelection(selectionCombo->currentData().toBool());
+        settings.setCoverHeadroomPercent(headroomSpin->value());
         settings.setFfmpegCrf(crfSpin->value());
         settings.setFfmpegPreset(presetCombo->currentText());
+        settings.setScaleCpuBudgetPercent(cpuBudgetSpin->value());
+        applyScaleBudget();
+        settings.setNativeImageScaler(nativeImageCheck->isChecked());
+        settings.setJpegQuality(jpegQualitySpin->value());
+        settings.setCdnImageResize(cdnImagesCheck->isChecked());
+        settings.setVerifyCdnImages(verifyCdnCheck->isChecked());
+        settings.setUseMediaStore(mediaStoreCheck->isChecked());
         m_statusLabel->setText("Settings saved");
     }
 }
@@ -596,9 +1040,9 @@ void MainWindow::onSearch()
     m_api->search(query, m_currentSearchType, 1, 40, m_minDurationSpin->value());
 }
 
-void MainWindow::onSearchCompleted(const QList<MediaMetadata>& media, int totalResults, int page)
+void MainWindow::onSearchCompleted(const SearchPage& results, int totalResults, int page)
 {
-    qDebug() << "onSearchCompleted: media=" << media.size() << "total=" << totalResults << "page=" << page;
+    qDebug() << "onSearchCompleted: media=" << results.size() << "total=" << totalResults << "page=" << page;
 
     m_totalResults = totalResults;
     m_currentPage = page;
@@ -619,9 +1063,9 @@ void MainWindow::onSearchCompleted(const QList<MediaMetadata>& media, int totalR
     // For new search, reset start count
     if (page == 1) {
         m_loadMoreStartCount = 0;
-        m_mediaList->setSearchResults(media, rejectedIds, projectIds);
+        m_mediaList->setSearchResults(results, rejectedIds, projectIds);
     } else {
-        m_mediaList->addSearchResults(media, rejectedIds, projectIds);
+        m_mediaList->addSearchResults(results, rejectedIds, projectIds);
     }
 
     int countAfter = m_mediaList->searchResultsCount();
@@ -740,6 +1184,9 @@ void MainWindow::onMediaSelected(const MediaMetadata& media)
 {
     qDebug() << "MainWindow::onMediaSelected id=" << media.id << "type=" << (media.isVideo() ? "video" : "image");
 
+    // The user is looking at it, so a queued download of it goes next
+    m_downloadManager->boost(media.id);
+
     // Prefer local file if downloaded
     if (!media.localScaledPath.isEmpty() && QFile::exists(media.localScaledPath)) {
         qDebug() << "  -> showing scaled file";
@@ -806,38 +1253,99 @@ void MainWindow::onDownloadSelected()
     if (!m_projectManager->hasProject()) return;
 
     auto& project = m_projectManager->project();
+    auto& settings = Settings::instance();
     int maxWidth = m_resolutionCombo->currentData().toInt();
+    bool coverTarget = settings.coverTargetSelection();
+    QList<Rendition> ladder = project.outputRenditions();
+    const Rendition& primary = ladder.first();
+    bool cdnImages = settings.cdnImageResize() && ladder.size() == 1;  // The CDN crops to one size
+    bool useStore = settings.useMediaStore();
+    bool streamIngest = settings.streamIngest();
+    double headroom = 1.0 + settings.coverHeadroomPercent() / 100.0;
     int count = 0;
 
+    // The source has to cover the largest rendition
+    QSize cover;
+    for (const auto& rendition : ladder) {
+        cover = cover.expandedTo(QSize(rendition.width, rendition.height));
+    }
+    qint64 projectedSaved = 0;
+
     for (auto& item : project.media) {
         if (item.isRejected || item.isDownloaded) continue;
-
-        QUrl downloadUrl = item.getDownloadUrl(maxWidth);
-        if (downloadUrl.isEmpty()) continue;
-
-        QString ext = item.getFileExtension();
-        QString filename;
-
-        if (item.isVideo()) {
-            filename = QString("%1_%2_%3s%4")
-                .arg(item.id)
-                .arg(item.author.left(20).replace(' ', '_'))
-                .arg(item.duration)
-                .arg(ext);
+        if (m_downloadManager->isQueued(item.id)) continue;  // E.g. resumed from the journal
+
+        QUrl downloadUrl;
+        QString rendition;
+        qint64 expectedBytes = -1;  // Lets the queue run small items first
+        if (item.isVideo() && coverTarget) {
+            MediaFile largest = item.getBestMediaFile(maxWidth);
+            MediaFile covering = item.getCoveringMediaFile(cover.width(), cover.height(), headroom, maxWidth);
+            projectedSaved += largest.estimatedBytes(item.duration) - covering.estimatedBytes(item.duration);
+            downloadUrl = covering.link;
+            rendition = QString("%1x%2").arg(covering.width).arg(covering.height);
+            expectedBytes = covering.estimatedBytes(item.duration);
         } else {
-            filename = QString("%1_%2%3")
-                .arg(item.id)
-                .arg(item.author.left(20).replace(' ', '_'))
-                .arg(ext);
+            downloadUrl = item.getDownloadUrl(maxWidth);
+            if (item.isVideo()) {
+                MediaFile best = item.getBestMediaFile(maxWidth);
+                rendition = QString("%1x%2").arg(best.width).arg(best.height);
+                expectedBytes = best.estimatedBytes(item.duration);
+            } else {
+                rendition = item.largeImageUrl.isEmpty() ? "original" : "large";
+                // ~2 bits per pixel for a Pexels JPEG, at the size large2x actually delivers
+                QSize size = item.getDownloadSize();
+                expectedBytes = qint64(size.width()) * size.height() / 4;
+            }
         }
+        if (downloadUrl.isEmpty()) continue;
 
-        // Remove invalid characters
-        filename.replace(QRegularExpression("[<>:\"/\\\\|?*]"), "_");
+        QString filename = rawFileName(item);
+
+        if (item.isImage() && cdnImages) {
+            QUrl sizedUrl = item.getSizedImageUrl(primary.width, primary.height, settings.jpegQuality());
+            if (!sizedUrl.isEmpty()) {
+                // Already at target size, so it goes straight to the scaled directory
+                QString destPath = project.scaledDir() + "/" + QFileInfo(filename).completeBaseName()
+                    + item.getFileExtension();
+                QString sizedKey = useStore ? MediaStore::makeKey("pexels", item.id,
+                    QString("cdn_%1x%2_q%3").arg(primary.width).arg(primary.height).arg(settings.jpegQuality()))
+                    : QString();
+                m_cdnSizedKeys.insert(item.id, sizedKey);
+                m_downloadManager->downloadMedia(item.id, sizedUrl, destPath, DownloadEngine::Normal,
+                                                 qint64(primary.width) * primary.height / 4,
+                                                 sizedKey);
+                count++;
+                continue;
+            }
+        }
 
         QString destPath = project.rawDir() + "/" + filename;
+        QString storeKey = useStore ? MediaStore::makeKey("pexels", item.id, rendition) : QString();
+
+        if (item.isVideo() && streamIngest) {
+            // Scaled while downloading; the raw file is only written when it is to be kept
+            // ffmpeg writes partial names the engine renames on a clean exit
+            QList<UploadManager::ScaleOutput> outputs = prepareScaleOutputs(item, filename);
+            QStringList outputPaths;
+            for (auto& output : outputs) {
+                outputPaths << output.path;
+                output.path = DownloadEngine::partialOutputPath(output.path);
+            }
+            QStringList args = UploadManager::ladderArguments(item.type, "pipe:0", outputs,
+                settings.ffmpegPreset(), UploadManager::threadsPerJob(item.type));
+            m_ingestFallbacks.insert(item.id, {downloadUrl, DownloadEngine::Normal, expectedBytes, storeKey});
+            m_downloadManager->ingestMedia(item.id, downloadUrl, args, outputPaths,
+                                           settings.ingestKeepRaw() ? destPath : QString(),
+                                           DownloadEngine::Normal, expectedBytes);
+            count++;
+            continue;
+        }
+
         item.localRawPath = destPath;
 
-        m_downloadManager->downloadMedia(item.id, downloadUrl, destPath);
+        m_downloadManager->downloadMedia(item.id, downloadUrl, destPath, DownloadEngine::Normal, expectedBytes,
+                                         storeKey);
         count++;
     }
 
@@ -845,43 +1353,50 @@ void MainWindow::onDownloadSelected()
         m_downloadTotal = count;
         m_downloadCompleted = 0;
         m_progressBar->setVisible(true);
-        m_statusLabel->setText(QString("Downloading 1/%1 items...").arg(count));
+        QString status = QString("Downloading 1/%1 items...").arg(count);
+        if (coverTarget) {
+            qDebug() << "Target-aware selection: projected bytes saved =" << projectedSaved;
+            status += QString(" (~%1 saved vs largest)").arg(QLocale().formattedDataSize(projectedSaved));
+        }
+        m_statusLabel->setText(status);
     } else {
         m_statusLabel->setText("No media to download");
     }
 }
 
+QString MainWindow::rawFileName(const MediaMetadata& item) const
+{
+    QString ext = item.getFileExtension();
+    QString filename;
+
+    if (item.isVideo()) {
+        filename = QString("%1_%2_%3s%4")
+            .arg(item.id)
+            .arg(item.author.left(20).replace(' ', '_'))
+            .arg(item.duration)
+            .arg(ext);
+    } else {
+        filename = QString("%1_%2%3")
+            .arg(item.id)
+            .arg(item.author.left(20).replace(' ', '_'))
+            .arg(ext);
+    }
+
+    // Remove invalid characters
+    filename.replace(QRegularExpression("[<>:\"/\\\\|?*]"), "_");
+    return filename;
+}
+
 void MainWindow::onScaleSelected()
 {
     if (!m_projectManager->hasProject()) return;
 
-    auto& project = m_projectManager->project();
-    auto& settings = Settings::instance();
     int count = 0;
-
-    for (auto& item : project.media) {
+    for (auto& item : m_projectManager->project().media) {
         if (item.isRejected || !item.isDownloaded || item.isScaled) continue;
-        if (!QFile::exists(item.localRawPath)) continue;
-
-        QString inputFilename = QFileInfo(item.localRawPath).fileName();
-        QString outputExt = item.getFileExtension();
-
-        // Change extension if needed (e.g., downloaded as .png, output as .jpg)
-        QString baseName = QFileInfo(inputFilename).completeBaseName();
-        QString destPath = project.scaledDir() + "/" + baseName + outputExt;
-        item.localScaledPath = destPath;
-
-        m_uploadManager->scaleMedia(
-            item.id,
-            item.type,
-            item.localRawPath,
-            destPath,
-            settings.targetWidth(),
-            settings.targetHeight(),
-            settings.ffmpegCrf(),
-            settings.ffmpegPreset()
-        );
-        count++;
+        if (queueScale(item)) {
+            count++;
+        }
     }
 
     if (count > 0) {
@@ -905,15 +1420,11 @@ void MainWindow::onUploadSelected()
     }
 
     int count = 0;
-
     for (auto& item : project.media) {
         if (item.isRejected || !item.isScaled || item.isUploaded) continue;
-        if (!QFile::exists(item.localScaledPath)) continue;
-
-        QString key = "media/" + QFileInfo(item.localScaledPath).fileName();
-
-        m_uploadManager->uploadToS3(item.id, item.localScaledPath, project.s3Bucket, key);
-        count++;
+        if (queueUpload(item)) {
+            count++;
+        }
     }
 
     if (count > 0) {
@@ -921,7 +1432,7 @@ void MainWindow::onUploadSelected()
         m_uploadCompleted = 0;
         // Also upload index.json, catalog.json, and categories.json
         m_uploadManager->uploadIndexJson(project.s3Bucket, project.categoryId, project.name);
-        m_uploadManager->uploadCatalogJson(project.s3Bucket, project.categoryId, project.media);
+        m_uploadManager->uploadCatalogJson(project.s3Bucket, project.categoryId, project.media, project.renditions);
         m_uploadManager->uploadCategoriesJson(project.s3Bucket, project.categoryId, project.name);
         m_statusLabel->setText(QString("Uploading 1/%1 items...").arg(count));
     } else {
@@ -931,9 +1442,50 @@ void MainWindow::onUploadSelected()
 
 void MainWindow::onDownloadCompleted(int mediaId, const QString& path)
 {
+    auto& settings = Settings::instance();
+    bool cdnSized = m_cdnSizedKeys.contains(mediaId);
+    QString sizedKey = m_cdnSizedKeys.take(mediaId);
+
+    if (cdnSized && settings.verifyCdnImages()) {
+        Rendition primary = m_projectManager->project().outputRenditions().first();
+        QSize expected(primary.width, primary.height);
+        QSize actual = QImageReader(path).size();
+        if (actual != expected) {
+            qDebug() << "CDN image" << mediaId << "is" << actual << "expected" << expected
+                     << "- falling back to download and scale";
+            QFile::remove(path);
+
+            // The engine already adopted it into the store; a later request must not get it again
+            if (!sizedKey.isEmpty()) {
+                MediaStore::instance().evict(sizedKey);
+            }
+
+            auto& project = m_projectManager->project();
+            if (MediaMetadata* item = findProjectMedia(mediaId)) {
+                QString rendition = item->largeImageUrl.isEmpty() ? "original" : "large";
+                QString storeKey = settings.useMediaStore() ? MediaStore::makeKey("pexels", item->id, rendition)
+                                                            : QString();
+                item->localRawPath = project.rawDir() + "/" + rawFileName(*item);
+                QSize size = item->getDownloadSize();
+                m_downloadManager->downloadMedia(item->id, item->getDownloadUrl(), item->localRawPath,
+                                                 DownloadEngine::Normal, qint64(size.width()) * size.height() / 4,
+                                                 storeKey);
+            }
+            return;
+        }
+    }
+
     for (auto& item : m_projectManager->project().media) {
         if (item.id == mediaId) {
-            item.localRawPath = path;
+            if (cdnSized) {
+                // CDN sizing only runs with a one-rendition ladder; drop paths from an earlier one
+                item.localRawPath.clear();
+                item.renditionPaths.clear();
+                item.localScaledPath = path;
+                item.isScaled = true;
+            } else {
+                item.localRawPath = path;
+            }
             item.isDownloaded = true;
             m_projectManager->updateMedia(item);
             m_mediaList->updateMediaStatus(mediaId, &item);
@@ -941,6 +1493,13 @@ void MainWindow::onDownloadCompleted(int mediaId, const QString& path)
         }
     }
 
+    // CDN-sized photos are already scaled and go straight to the upload stage
+    if (cdnSized) {
+        m_pipeline->scaleFinished(mediaId);
+    } else {
+        m_pipeline->downloadFinished(mediaId);
+    }
+
     m_downloadCompleted++;
 
     if (!m_downloadManager->isDownloading()) {
@@ -951,6 +1510,158 @@ void MainWindow::onDownloadCompleted(int mediaId, const QString& path)
     }
 }
 
+void MainWindow::onIngestCompleted(int mediaId, const QString& scaledPath, const QString& rawPath)
+{
+    m_ingestFallbacks.remove(mediaId);
+
+    if (MediaMetadata* item = findProjectMedia(mediaId)) {
+        item->localRawPath = rawPath;
+        item->localScaledPath = scaledPath;
+        item->isDownloaded = true;
+        item->isScaled = true;
+        m_projectManager->updateMedia(*item);
+        m_mediaList->updateMediaStatus(mediaId, item);
+    }
+
+    // Already scaled, so it goes straight to the upload stage
+    m_pipeline->scaleFinished(mediaId);
+
+    m_downloadCompleted++;
+
+    if (!m_downloadManager->isDownloading()) {
+        m_progressBar->setVisible(false);
+        m_statusLabel->setText(QString("Downloaded %1 items").arg(m_downloadCompleted));
+    } else {
+        m_statusLabel->setText(QString("Downloading %1/%2 items...").arg(m_downloadCompleted + 1).arg(m_downloadTotal));
+    }
+}
+
+void MainWindow::resumeQueuedDownloads()
+{
+    auto& project = m_projectManager->project();
+    QList<QueuedDownload> queued = m_downloadManager->openJournal(project.path + "/download_queue.json");
+    if (queued.isEmpty()) return;
+
+    for (const auto& entry : queued) {
+        if (entry.destPath.startsWith(project.scaledDir())) {
+            m_cdnSizedKeys.insert(entry.mediaId, entry.storeKey);
+        }
+        m_downloadManager->downloadMedia(entry.mediaId, entry.url, entry.destPath, entry.priority,
+                                         entry.expectedBytes, entry.storeKey);
+    }
+
+    m_downloadTotal = queued.size();
+    m_downloadCompleted = 0;
+    m_progressBar->setVisible(true);
+    m_statusLabel->setText(QString("Resuming %1 queued downloads...").arg(queued.size()));
+}
+
+bool MainWindow::queueScale(MediaMetadata& item)
+{
+    if (!QFile::exists(item.localRawPath)) return false;
+
+    auto& settings = Settings::instance();
+
+    m_uploadManager->scaleLadder(
+        item.id,
+        item.type,
+        item.localRawPath,
+        prepareScaleOutputs(item, QFileInfo(item.localRawPath).fileName()),
+        settings.ffmpegPreset(),
+        item.duration
+    );
+    return true;
+}
+
+QList<UploadManager::ScaleOutput> MainWindow::prepareScaleOutputs(MediaMetadata& item, const QString& fileName)
+{
+    auto& project = m_projectManager->project();
+    QList<Rendition> ladder = project.outputRenditions();
+    // The extension follows the type (e.g., downloaded as .png, output as .jpg)
+    QString baseName = QFileInfo(fileName).completeBaseName();
+    QString extension = item.getFileExtension();
+
+    QList<UploadManager::ScaleOutput> outputs;
+    item.renditionPaths.clear();
+    for (int i = 0; i < ladder.size(); ++i) {
+        QString path = project.renditionPath(baseName, extension, i);
+        if (i == 0) {
+            item.localScaledPath = path;
+        } else {
+            item.renditionPaths[ladder[i].name] = path;
+        }
+        int crf = ladder[i].crf > 0 ? ladder[i].crf : Settings::instance().ffmpegCrf();
+        outputs.append({path, ladder[i].width, ladder[i].height, crf});
+    }
+    return outputs;
+}
+
+bool MainWindow::queueUpload(MediaMetadata& item)
+{
+    auto& project = m_projectManager->project();
+    if (project.s3Bucket.isEmpty()) return false;
+    if (!QFile::exists(item.localScaledPath)) return false;
+
+    // Already uploading its renditions; that upload reports for both requests
+    if (m_renditionUploads.contains(item.id)) return true;
+
+    QStringList paths = item.scaledPaths(project.outputRenditions());
+    if (paths.size() > 1) {
+        m_renditionUploads[item.id] = {int(paths.size()), false};
+    }
+    for (const QString& path : paths) {
+        QString key = "media/" + QFileInfo(path).fileName();
+        m_uploadManager->uploadToS3(item.id, path, project.s3Bucket, key);
+    }
+    return true;
+}
+
+bool MainWindow::finishRenditionUpload(int mediaId, bool& failed)
+{
+    auto it = m_renditionUploads.find(mediaId);
+    if (it == m_renditionUploads.end()) return true;
+
+    it->failed |= failed;
+    if (--it->remaining > 0) return false;
+
+    failed = it->failed;
+    m_renditionUploads.erase(it);
+    return true;
+}
+
+void MainWindow::applyScaleBudget()
+{
+    // Video jobs that fit the CPU budget together. The pipeline hands out no more, so
+    // its backpressure sees the waiting items, and streamed ingests share the same count.
+    int videoJobs = qMax(1, UploadManager::scaleThreadBudget() / UploadManager::threadsPerJob(MediaType::Video));
+    m_pipeline->setStageLimits(qMin(videoJobs, int(UploadManager::MAX_CONCURRENT_SCALES)),
+                               UploadManager::MAX_CONCURRENT_UPLOADS);
+    m_downloadManager->setIngestLimit(videoJobs);
+}
+
+MediaMetadata* MainWindow::findProjectMedia(int mediaId)
+{
+    for (auto& item : m_projectManager->project().media) {
+        if (item.id == mediaId) return &item;
+    }
+    return nullptr;
+}
+
+void MainWindow::finishPipelineBatch()
+{
+    if (!m_pipeline->isIdle() || m_downloadManager->isDownloading()) return;
+    if (m_pipelineUploads == 0) return;
+
+    // Publish the catalogs once per batch rather than after every item
+    auto& project = m_projectManager->project();
+    m_uploadManager->uploadIndexJson(project.s3Bucket, project.categoryId, project.name);
+    m_uploadManager->uploadCatalogJson(project.s3Bucket, project.categoryId, project.media, project.renditions);
+    m_uploadManager->uploadCategoriesJson(project.s3Bucket, project.categoryId, project.name);
+    m_statusLabel->setText(QString("Pipeline finished: %1 items uploaded").arg(m_pipelineUploads));
+    m_pipelineUploads = 0;
+    m_projectManager->saveProject();
+}
+
 void MainWindow::onScaleCompleted(int mediaId, const QString& path)
 {
     for (auto& item : m_projectManager->project().media) {
@@ -963,6 +1674,12 @@ void MainWindow::onScaleCompleted(int mediaId, const QString& path)
         }
     }
 
+    m_scaleProgress.remove(mediaId);
+    updateScaleProgress();
+
+    m_pipeline->scaleDone(mediaId);
+    m_pipeline->scaleFinished(mediaId);
+
     m_scaleCompleted++;
 
     if (!m_uploadManager->isBusy()) {
@@ -974,6 +1691,14 @@ void MainWindow::onScaleCompleted(int mediaId, const QString& path)
 
 void MainWindow::onUploadCompleted(int mediaId)
 {
+    // An item with several renditions is uploaded once all of them are
+    bool failed = false;
+    if (!finishRenditionUpload(mediaId, failed)) return;
+    if (failed) {
+        m_pipeline->uploadDone(mediaId);
+        return;
+    }
+
     for (auto& item : m_projectManager->project().media) {
         if (item.id == mediaId) {
             item.isUploaded = true;
@@ -983,6 +1708,11 @@ void MainWindow::onUploadCompleted(int mediaId)
         }
     }
 
+    if (m_pipeline->isEnabled()) {
+        m_pipelineUploads++;
+    }
+    m_pipeline->uploadDone(mediaId);
+
     m_uploadCompleted++;
 
     if (!m_uploadManager->isBusy()) {
@@ -992,6 +1722,37 @@ void MainWindow::onUploadCompleted(int mediaId)
     }
 }
 
+void MainWindow::updateScaleProgress()
+{
+    auto formatEta = [](int seconds) {
+        if (seconds < 0) return QString("?");
+        return QTime(0, 0).addSecs(seconds).toString(seconds >= 3600 ? "h:mm:ss" : "m:ss");
+    };
+
+    m_scaleProgressLabel->setVisible(!m_scaleProgress.isEmpty());
+    if (m_scaleProgress.isEmpty()) return;
+
+    // The batch of running encodes is done when the slowest one is
+    int eta = 0;
+    QStringList lines;
+    for (auto it = m_scaleProgress.cbegin(); it != m_scaleProgress.cend(); ++it) {
+        const auto& progress = it.value();
+        eta = (eta < 0 || progress.etaSeconds < 0) ? -1 : qMax(eta, progress.etaSeconds);
+        lines << QString("%1: %2 frames, %3 fps, %4x, ETA %5")
+            .arg(it.key()).arg(progress.frames).arg(progress.fps, 0, 'f', 1)
+            .arg(progress.speed, 0, 'f', 2).arg(formatEta(progress.etaSeconds));
+    }
+
+    if (m_scaleProgress.size() == 1) {
+        const auto& progress = m_scaleProgress.first();
+        m_scaleProgressLabel->setText(QString("Encoding %1 fps, %2x, ETA %3")
+            .arg(progress.fps, 0, 'f', 1).arg(progress.speed, 0, 'f', 2).arg(formatEta(eta)));
+    } else {
+        m_scaleProgressLabel->setText(QString("%1 encodes, ETA %2").arg(m_scaleProgress.size()).arg(formatEta(eta)));
+    }
+    m_scaleProgressLabel->setToolTip(lines.join("\n"));
+}
+
 void MainWindow::updateStatus()
 {
     // Could add more detailed status updates here
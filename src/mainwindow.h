@@ -15,6 +15,7 @@
 #include "projectmanager.h"
 #include "downloadmanager.h"
 #include "uploadmanager.h"
+#include "pipelinecontroller.h"
 
 class MainWindow : public QMainWindow
 {
@@ -36,11 +37,13 @@ private slots:
     void onDeleteProject();
     void onOpenProjectDir();
     void onUploadCatalog();
+    void onReconcileBucket();
+    void onEditRenditions();
     void onSettings();
 
     // Search
     void onSearch();
-    void onSearchCompleted(const QList<MediaMetadata>& media, int totalResults, int page);
+    void onSearchCompleted(const SearchPage& results, int totalResults, int page);
     void onSearchError(const QString& error);
     void onLoadMore();
     void onAddToProject();
@@ -56,6 +59,7 @@ private slots:
     void onUploadSelected();
 
     void onDownloadCompleted(int mediaId, const QString& path);
+    void onIngestCompleted(int mediaId, const QString& scaledPath, const QString& rawPath);
     void onScaleCompleted(int mediaId, const QString& path);
     void onUploadCompleted(int mediaId);
 
@@ -68,6 +72,17 @@ private:
     void restoreState();
     void saveState();
     void updateProjectUi();
+    void resumeQueuedDownloads();
+    bool queueScale(MediaMetadata& item);
+    bool queueUpload(MediaMetadata& item);
+    bool finishRenditionUpload(int mediaId, bool& failed);
+    QList<UploadManager::ScaleOutput> prepareScaleOutputs(MediaMetadata& item, const QString& fileName);
+    MediaMetadata* findProjectMedia(int mediaId);
+    void finishPipelineBatch();
+    void updateScaleProgress();
+    void applyScaleBudget();
+    void applyBucketListing(const QString& bucket, const QList<S3Object>& objects);
+    QString rawFileName(const MediaMetadata& item) const;
 
     // UI components
     QSplitter* m_splitter;
@@ -95,6 +110,8 @@ private:
     QPushButton* m_scaleBtn;
     QPushButton* m_uploadBtn;
     QProgressBar* m_progressBar;
+    QLabel* m_transferStatsLabel;
+    QLabel* m_scaleProgressLabel;
     QLabel* m_statusLabel;
 
     // Core components
@@ -102,6 +119,7 @@ private:
     ProjectManager* m_projectManager;
     DownloadManager* m_downloadManager;
     UploadManager* m_uploadManager;
+    PipelineController* m_pipeline;
 
     // Search state
     QString m_currentQuery;
@@ -117,4 +135,28 @@ private:
     int m_scaleCompleted = 0;
     int m_uploadTotal = 0;
     int m_uploadCompleted = 0;
+    int m_pipelineUploads = 0;  // Uploaded by the pipeline since the catalogs were last published
+
+    // Photos being fetched pre-sized from the CDN (written straight to scaledDir),
+    // with their media store key (empty when the store is off)
+    QMap<int, QString> m_cdnSizedKeys;
+
+    // Videos streamed straight into ffmpeg, with the download to fall back to on failure
+    struct IngestFallback {
+        QUrl url;
+        DownloadEngine::Priority priority = DownloadEngine::Normal;
+        qint64 expectedBytes = -1;
+        QString storeKey;
+    };
+    QMap<int, IngestFallback> m_ingestFallbacks;
+
+    // Running encodes, from the upload manager's scaleProgress
+    QMap<int, UploadManager::ScaleProgress> m_scaleProgress;
+
+    // Items uploading several renditions: files left, and whether one failed
+    struct RenditionUpload {
+        int remaining = 0;
+        bool failed = false;
+    };
+    QMap<int, RenditionUpload> m_renditionUploads;
 };
@@ -1,4 +1,7 @@
 #include "medialistwidget.h"
+#include "allocationcounter.h"
+#include "bandwidthscheduler.h"
+#include "networkservice.h"
 #include <QKeyEvent>
 #include <QPixmap>
 #include <QNetworkRequest>
@@ -17,30 +20,49 @@ MediaListWidget::MediaListWidget(QWidget* parent)
 
 // === Search Results ===
 
-void MediaListWidget::setSearchResults(const QList<MediaMetadata>& media, const QSet<int>& rejectedIds, const QSet<int>& projectIds)
+void MediaListWidget::setSearchResults(const SearchPage& results, const QSet<int>& rejectedIds, const QSet<int>& projectIds)
 {
     m_searchResults.clear();
-    addSearchResults(media, rejectedIds, projectIds);
+    addSearchResults(results, rejectedIds, projectIds);
 }
 
-void MediaListWidget::addSearchResults(const QList<MediaMetadata>& media, const QSet<int>& rejectedIds, const QSet<int>& projectIds)
+void MediaListWidget::addSearchResults(const SearchPage& results, const QSet<int>& rejectedIds, const QSet<int>& projectIds)
 {
-    qDebug() << "addSearchResults: incoming=" << media.size()
+    qDebug() << "addSearchResults: incoming=" << results.size()
              << "rejected=" << rejectedIds.size()
              << "inProject=" << projectIds.size();
 
     int added = 0, skippedDupe = 0, skippedRejected = 0, skippedProject = 0;
-
-    for (const auto& item : media) {
-        if (m_searchResults.contains(item.id)) { skippedDupe++; continue; }
-        if (rejectedIds.contains(item.id)) { skippedRejected++; continue; }
-        if (projectIds.contains(item.id)) { skippedProject++; continue; }
-        m_searchResults[item.id] = item;
+    quint64 allocationsBefore = AllocationCounter::count();
+
+    // Filter on the raw id first; only survivors are decoded into long-lived MediaMetadata
+    for (int i = 0; i < results.size(); ++i) {
+        int id = results.idAt(i);
+        if (m_searchResults.contains(id)) { skippedDupe++; continue; }
+        if (rejectedIds.contains(id)) { skippedRejected++; continue; }
+        if (projectIds.contains(id)) { skippedProject++; continue; }
+        m_searchResults.insert(id, results.materialize(i));
         added++;
     }
 
     qDebug() << "  added=" << added << "skippedDupe=" << skippedDupe
              << "skippedRejected=" << skippedRejected << "skippedProject=" << skippedProject;
+
+    if (AllocationCounter::enabled()) {
+        quint64 filtered = AllocationCounter::count() - allocationsBefore;
+
+        // Benchmark: what decoding every result up front would have cost
+        quint64 eagerBefore = AllocationCounter::count();
+        {
+            QList<MediaMetadata> eager;
+            eager.reserve(results.size());
+            for (int i = 0; i < results.size(); ++i) {
+                eager.append(results.materialize(i));
+            }
+        }
+        qDebug() << "  allocations: filtered=" << filtered
+                 << "eager=" << AllocationCounter::count() - eagerBefore;
+    }
     qDebug() << "  m_searchResults.size()=" << m_searchResults.size()
              << "m_viewMode=" << (m_viewMode == SearchResults ? "SearchResults" : "ProjectMedia");
 
@@ -105,7 +127,8 @@ void MediaListWidget::refreshList()
              << "searchResults=" << m_searchResults.size()
              << "projectMedia=" << m_projectMedia.size();
 
-    // Cancel pending thumbnails
+    // Cancel pending thumbnails, including those still waiting for a connection
+    NetworkService::instance().cancelQueued(this);
     for (auto reply : m_pendingThumbnails.keys()) {
         reply->abort();
         reply->deleteLater();
@@ -135,6 +158,7 @@ void MediaListWidget::clear()
     m_searchResults.clear();
     m_projectMedia.clear();
 
+    NetworkService::instance().cancelQueued(this);
     for (auto reply : m_pendingThumbnails.keys()) {
         reply->abort();
         reply->deleteLater();
@@ -275,13 +299,11 @@ void MediaListWidget::onCurrentItemChanged(QListWidgetItem* current, QListWidget
 
 void MediaListWidget::loadThumbnail(int mediaId, const QUrl& url)
 {
-    QNetworkRequest request(url);
-    request.setRawHeader("User-Agent", "PexelManager/1.0");
-
-    auto reply = m_thumbnailNetwork.get(request);
-    m_pendingThumbnails[reply] = mediaId;
-
-    connect(reply, &QNetworkReply::finished, this, &MediaListWidget::onThumbnailLoaded);
+    NetworkService::instance().get(QNetworkRequest(url), BandwidthScheduler::Thumbnail, this,
+                                   [this, mediaId](QNetworkReply* reply) {
+        m_pendingThumbnails[reply] = mediaId;
+        connect(reply, &QNetworkReply::finished, this, &MediaListWidget::onThumbnailLoaded);
+    });
 }
 
 void MediaListWidget::onThumbnailLoaded()
@@ -292,8 +314,11 @@ void MediaListWidget::onThumbnailLoaded()
     int mediaId = m_pendingThumbnails.take(reply);
 
     if (reply->error() == QNetworkReply::NoError) {
+        QByteArray data = reply->readAll();
+        BandwidthScheduler::instance().consume(BandwidthScheduler::Thumbnail, data.size());
+
         QPixmap pixmap;
-        if (pixmap.loadFromData(reply->readAll())) {
+        if (pixmap.loadFromData(data)) {
             auto item = findItem(mediaId);
             if (item) {
                 item->setIcon(QIcon(pixmap.scaled(160, 90, Qt::KeepAspectRatio, Qt::SmoothTransformation)));
@@ -1,7 +1,6 @@
 #pragma once
 
 #include <QListWidget>
-#include <QNetworkAccessManager>
 #include <QMap>
 #include <QSet>
 #include "mediametadata.h"
@@ -14,8 +13,8 @@ public:
     explicit MediaListWidget(QWidget* parent = nullptr);
 
     // Search results (temporary, before adding to project)
-    void setSearchResults(const QList<MediaMetadata>& media, const QSet<int>& rejectedIds, const QSet<int>& projectIds);
-    void addSearchResults(const QList<MediaMetadata>& media, const QSet<int>& rejectedIds, const QSet<int>& projectIds);
+    void setSearchResults(const SearchPage& results, const QSet<int>& rejectedIds, const QSet<int>& projectIds);
+    void addSearchResults(const SearchPage& results, const QSet<int>& rejectedIds, const QSet<int>& projectIds);
     void clearSearchResults();
     QList<MediaMetadata> getSearchResults() const;
     int searchResultsCount() const { return m_searchResults.size(); }
@@ -58,6 +57,5 @@ private:
     ViewMode m_viewMode = SearchResults;
     QMap<int, MediaMetadata> m_searchResults;
     QMap<int, MediaMetadata> m_projectMedia;
-    QNetworkAccessManager m_thumbnailNetwork;
     QMap<QNetworkReply*, int> m_pendingThumbnails;
 };
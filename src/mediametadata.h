@@ -2,8 +2,12 @@
 
 #include <QString>
 #include <QUrl>
+#include <QUrlQuery>
+#include <QSize>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QMap>
+#include <QtMath>
 
 enum class MediaType {
     Video,
@@ -13,19 +17,57 @@ enum class MediaType {
 struct MediaFile {
     int width = 0;
     int height = 0;
+    double fps = 0.0;
+    qint64 size = 0;  // Bytes, 0 if the API didn't report it
     QString quality;
     QUrl link;
 
+    // Known size, or a rough estimate from resolution and duration
+    qint64 estimatedBytes(int durationSec) const {
+        if (size > 0) return size;
+        // ~0.1 bits per pixel per frame is typical for H.264 stock footage
+        double frameRate = fps > 0 ? fps : 30.0;
+        return static_cast<qint64>(double(width) * height * frameRate * durationSec * 0.1 / 8);
+    }
+
     static MediaFile fromJson(const QJsonObject& json) {
         MediaFile mf;
         mf.width = json["width"].toInt();
         mf.height = json["height"].toInt();
+        mf.fps = json["fps"].toDouble();
+        mf.size = json["size"].toInteger();
         mf.quality = json["quality"].toString();
         mf.link = QUrl(json["link"].toString());
         return mf;
     }
 };
 
+// One output size of a project's rendition ladder
+struct Rendition {
+    QString name;  // Used in file names and the catalog
+    int width = 0;
+    int height = 0;
+    int crf = 0;   // 0 = the configured CRF
+
+    QJsonObject toJson() const {
+        QJsonObject obj;
+        obj["name"] = name;
+        obj["width"] = width;
+        obj["height"] = height;
+        obj["crf"] = crf;
+        return obj;
+    }
+
+    static Rendition fromJson(const QJsonObject& json) {
+        Rendition r;
+        r.name = json["name"].toString();
+        r.width = json["width"].toInt();
+        r.height = json["height"].toInt();
+        r.crf = json["crf"].toInt();
+        return r;
+    }
+};
+
 struct MediaMetadata {
     MediaType type = MediaType::Video;
     int id = 0;
@@ -48,6 +90,9 @@ struct MediaMetadata {
     // Local state
     QString localRawPath;
     QString localScaledPath;
+    QMap<QString, QString> renditionPaths;  // Further renditions by name; the first is localScaledPath
+    QString rawHash;    // XXH64 of the raw file, hex
+    qint64 rawBytes = 0;
     bool isRejected = false;
     bool isDownloaded = false;
     bool isScaled = false;
@@ -56,6 +101,19 @@ struct MediaMetadata {
     bool isVideo() const { return type == MediaType::Video; }
     bool isImage() const { return type == MediaType::Image; }
 
+    // Every scaled file of this item, the first rendition first and the others in ladder
+    // order; renditions the ladder no longer lists follow by name
+    QStringList scaledPaths(const QList<Rendition>& ladder = {}) const {
+        QStringList paths;
+        if (!localScaledPath.isEmpty()) paths << localScaledPath;
+        QMap<QString, QString> rest = renditionPaths;
+        for (int i = 1; i < ladder.size(); ++i) {
+            if (rest.contains(ladder[i].name)) paths << rest.take(ladder[i].name);
+        }
+        paths << rest.values();
+        return paths;
+    }
+
     static MediaMetadata fromPexelsVideoJson(const QJsonObject& json) {
         MediaMetadata m;
         m.type = MediaType::Video;
@@ -74,6 +132,7 @@ struct MediaMetadata {
 
         // Parse video files
         auto files = json["video_files"].toArray();
+        m.mediaFiles.reserve(files.size());
         for (const auto& f : files) {
             auto mf = MediaFile::fromJson(f.toObject());
             if (!mf.link.isEmpty()) {
@@ -149,6 +208,33 @@ struct MediaMetadata {
         return best;
     }
 
+    // Get the smallest video file that still covers the target crop. Scaling fills
+    // the target at the source aspect ratio and then crops, so a file covers the
+    // target when both dimensions reach target * headroom. Falls back to
+    // getBestMediaFile() when nothing under maxWidth is large enough.
+    MediaFile getCoveringMediaFile(int targetWidth, int targetHeight, double headroom = 1.0,
+                                   int maxWidth = 1920) const {
+        int minWidth = qCeil(targetWidth * headroom);
+        int minHeight = qCeil(targetHeight * headroom);
+
+        MediaFile best;
+        qint64 bestArea = 0;
+
+        for (const auto& mf : mediaFiles) {
+            if (mf.width > maxWidth || mf.width < minWidth || mf.height < minHeight) continue;
+            qint64 area = qint64(mf.width) * mf.height;
+            if (bestArea == 0 || area < bestArea) {
+                bestArea = area;
+                best = mf;
+            }
+        }
+
+        if (best.link.isEmpty()) {
+            return getBestMediaFile(maxWidth);
+        }
+        return best;
+    }
+
     // Get download URL for this media item
     QUrl getDownloadUrl(int maxWidth = 1920) const {
         if (type == MediaType::Image) {
@@ -159,6 +245,38 @@ struct MediaMetadata {
         }
     }
 
+    // Get the pixel size getDownloadUrl() delivers for an image. The large2x URL asks the
+    // CDN to fit the photo within w x h at the given dpr; the original is never upscaled.
+    QSize getDownloadSize() const {
+        QSize original(width, height);
+        if (largeImageUrl.isEmpty()) return original;
+
+        QUrlQuery query(largeImageUrl);
+        int dpr = qMax(1, query.queryItemValue("dpr").toInt());
+        QSize bound(query.queryItemValue("w").toInt() * dpr, query.queryItemValue("h").toInt() * dpr);
+        if (bound.isEmpty() || original.isEmpty()) return original;
+        if (original.width() <= bound.width() && original.height() <= bound.height()) return original;
+        return original.scaled(bound, Qt::KeepAspectRatio);
+    }
+
+    // Get an image URL the Pexels CDN resizes and crops to exactly the given size, as a
+    // JPEG of the given quality (not auto=compress: the result is final output)
+    QUrl getSizedImageUrl(int targetWidth, int targetHeight, int quality) const {
+        QUrl url = originalImageUrl.isEmpty() ? largeImageUrl : originalImageUrl;
+        if (url.isEmpty()) return url;
+
+        QUrlQuery query;
+        query.addQueryItem("fm", "jpg");
+        query.addQueryItem("q", QString::number(quality));
+        query.addQueryItem("cs", "srgb");
+        query.addQueryItem("fit", "crop");
+        query.addQueryItem("w", QString::number(targetWidth));
+        query.addQueryItem("h", QString::number(targetHeight));
+        query.addQueryItem("dpr", "1");
+        url.setQuery(query);
+        return url;
+    }
+
     // Get file extension for this media type
     QString getFileExtension() const {
         return (type == MediaType::Image) ? ".jpg" : ".mp4";
@@ -177,6 +295,15 @@ struct MediaMetadata {
         obj["thumbnail_url"] = thumbnailUrl.toString();
         obj["local_raw_path"] = localRawPath;
         obj["local_scaled_path"] = localScaledPath;
+        if (!renditionPaths.isEmpty()) {
+            QJsonObject renditions;
+            for (auto it = renditionPaths.cbegin(); it != renditionPaths.cend(); ++it) {
+                renditions[it.key()] = it.value();
+            }
+            obj["rendition_paths"] = renditions;
+        }
+        obj["raw_hash"] = rawHash;
+        obj["raw_bytes"] = rawBytes;
         obj["is_rejected"] = isRejected;
         obj["is_downloaded"] = isDownloaded;
         obj["is_scaled"] = isScaled;
@@ -191,6 +318,8 @@ struct MediaMetadata {
                 QJsonObject mfObj;
                 mfObj["width"] = mf.width;
                 mfObj["height"] = mf.height;
+                mfObj["fps"] = mf.fps;
+                mfObj["size"] = mf.size;
                 mfObj["quality"] = mf.quality;
                 mfObj["link"] = mf.link.toString();
                 filesArray.append(mfObj);
@@ -221,6 +350,12 @@ struct MediaMetadata {
         m.thumbnailUrl = QUrl(json["thumbnail_url"].toString());
         m.localRawPath = json["local_raw_path"].toString();
         m.localScaledPath = json["local_scaled_path"].toString();
+        QJsonObject renditions = json["rendition_paths"].toObject();
+        for (auto it = renditions.constBegin(); it != renditions.constEnd(); ++it) {
+            m.renditionPaths[it.key()] = it.value().toString();
+        }
+        m.rawHash = json["raw_hash"].toString();
+        m.rawBytes = json["raw_bytes"].toInteger();
         m.isRejected = json["is_rejected"].toBool();
         m.isDownloaded = json["is_downloaded"].toBool();
         m.isScaled = json["is_scaled"].toBool();
@@ -245,3 +380,24 @@ struct MediaMetadata {
         return m;
     }
 };
+
+// One page of search results as decoded from the API response. The items stay
+// in the page's JSON storage and are only turned into MediaMetadata by
+// materialize(), so results dropped by filtering never allocate their strings,
+// URLs and file lists.
+struct SearchPage {
+    MediaType type = MediaType::Video;
+    QJsonArray items;
+
+    int size() const { return items.size(); }
+
+    int idAt(int index) const {
+        return items.at(index).toObject().value(QLatin1String("id")).toInt();
+    }
+
+    MediaMetadata materialize(int index) const {
+        QJsonObject json = items.at(index).toObject();
+        return (type == MediaType::Image) ? MediaMetadata::fromPexelsPhotoJson(json)
+                                          : MediaMetadata::fromPexelsVideoJson(json);
+    }
+};
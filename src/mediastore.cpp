@@ -0,0 +1,232 @@
+#include "mediastore.h"
+#include "settings.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QSaveFile>
+#include <QDebug>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+MediaStore& MediaStore::instance()
+{
+    static MediaStore instance;
+    return instance;
+}
+
+MediaStore::MediaStore()
+    : m_root(Settings::instance().storeDir())
+{
+    QDir(m_root).mkpath("objects");
+    load();
+}
+
+QString MediaStore::makeKey(const QString& provider, int id, const QString& rendition)
+{
+    return QString("%1/%2/%3").arg(provider).arg(id).arg(rendition);
+}
+
+bool MediaStore::checkout(const QString& key, const QString& destPath, QString* hash, qint64* size)
+{
+    QMutexLocker locker(&m_mutex);
+
+    auto keyIt = m_keys.constFind(key);
+    if (keyIt == m_keys.constEnd()) return false;
+
+    auto objectIt = m_objects.find(*keyIt);
+    if (objectIt == m_objects.end()) return false;
+
+    QString source = objectPath(*objectIt);
+    if (QFileInfo(source).size() != objectIt->size) {
+        qDebug() << "Media store object" << objectIt->fileName << "is missing or damaged";
+        return false;
+    }
+
+    QFile::remove(destPath);
+    if (!linkFile(source, destPath)) return false;
+
+    QString ref = QFileInfo(destPath).absoluteFilePath();
+    if (!objectIt->refs.contains(ref)) {
+        objectIt->refs.append(ref);
+        save();
+    }
+
+    if (hash) *hash = *keyIt;
+    if (size) *size = objectIt->size;
+    return true;
+}
+
+bool MediaStore::adopt(const QString& key, const QString& path, const QString& hex, qint64 size)
+{
+    if (hex.isEmpty()) return false;
+
+    QString ref = QFileInfo(path).absoluteFilePath();
+
+    QMutexLocker locker(&m_mutex);
+
+    auto objectIt = m_objects.find(hex);
+    if (objectIt != m_objects.end() && objectIt->size == size && QFile::exists(objectPath(*objectIt))) {
+        // Same content is already stored under another key: share it
+        QFile::remove(path);
+        if (!linkFile(objectPath(*objectIt), path)) return false;
+    } else {
+        Object object;
+        object.fileName = hex;
+        QString suffix = QFileInfo(path).suffix();
+        if (!suffix.isEmpty()) {
+            object.fileName += "." + suffix;
+        }
+        object.size = size;
+
+        QString target = objectPath(object);
+        QFile::remove(target);
+        if (!linkFile(path, target)) return false;
+        objectIt = m_objects.insert(hex, object);
+    }
+
+    if (!objectIt->refs.contains(ref)) {
+        objectIt->refs.append(ref);
+    }
+    m_keys[key] = hex;
+    save();
+    return true;
+}
+
+void MediaStore::evict(const QString& key)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_keys.remove(key) > 0) {
+        save();
+    }
+}
+
+qint64 MediaStore::collectGarbage()
+{
+    QMutexLocker locker(&m_mutex);
+
+    qint64 freed = 0;
+    int removed = 0;
+    for (auto it = m_objects.begin(); it != m_objects.end();) {
+        QStringList live;
+        for (const QString& ref : it->refs) {
+            if (QFile::exists(ref)) {
+                live.append(ref);
+            }
+        }
+        it->refs = live;
+
+        if (live.isEmpty()) {
+            QFile::remove(objectPath(*it));
+            freed += it->size;
+            removed++;
+            it = m_objects.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (auto it = m_keys.begin(); it != m_keys.end();) {
+        if (m_objects.contains(*it)) {
+            ++it;
+        } else {
+            it = m_keys.erase(it);
+        }
+    }
+
+    save();
+    if (removed > 0) {
+        qDebug() << "Media store: removed" << removed << "objects," << freed << "bytes";
+    }
+    return freed;
+}
+
+int MediaStore::refCount(const QString& key)
+{
+    QMutexLocker locker(&m_mutex);
+    auto keyIt = m_keys.constFind(key);
+    if (keyIt == m_keys.constEnd()) return 0;
+    return m_objects.value(*keyIt).refs.size();
+}
+
+QString MediaStore::objectPath(const Object& object) const
+{
+    return m_root + "/objects/" + object.fileName;
+}
+
+void MediaStore::load()
+{
+    QFile file(m_root + "/index.json");
+    if (!file.open(QIODevice::ReadOnly)) return;
+
+    QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+
+    QJsonObject keys = root["keys"].toObject();
+    for (auto it = keys.begin(); it != keys.end(); ++it) {
+        m_keys[it.key()] = it.value().toString();
+    }
+
+    QJsonObject objects = root["objects"].toObject();
+    for (auto it = objects.begin(); it != objects.end(); ++it) {
+        QJsonObject json = it.value().toObject();
+        Object object;
+        object.fileName = json["file"].toString();
+        object.size = json["size"].toInteger();
+        for (const auto& ref : json["refs"].toArray()) {
+            object.refs.append(ref.toString());
+        }
+        m_objects[it.key()] = object;
+    }
+}
+
+void MediaStore::save()
+{
+    QJsonObject keys;
+    for (auto it = m_keys.constBegin(); it != m_keys.constEnd(); ++it) {
+        keys[it.key()] = it.value();
+    }
+
+    QJsonObject objects;
+    for (auto it = m_objects.constBegin(); it != m_objects.constEnd(); ++it) {
+        QJsonObject json;
+        json["file"] = it->fileName;
+        json["size"] = it->size;
+        json["refs"] = QJsonArray::fromStringList(it->refs);
+        objects[it.key()] = json;
+    }
+
+    QJsonObject root;
+    root["keys"] = keys;
+    root["objects"] = objects;
+
+    QSaveFile file(m_root + "/index.json");
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(QJsonDocument(root).toJson());
+        file.commit();
+    }
+}
+
+bool MediaStore::linkFile(const QString& source, const QString& target, bool allowCopy)
+{
+    QDir().mkpath(QFileInfo(target).absolutePath());
+
+#ifdef Q_OS_WIN
+    if (CreateHardLinkW(reinterpret_cast<LPCWSTR>(QDir::toNativeSeparators(target).utf16()),
+                        reinterpret_cast<LPCWSTR>(QDir::toNativeSeparators(source).utf16()), nullptr)) {
+        return true;
+    }
+#else
+    if (::link(QFile::encodeName(source).constData(), QFile::encodeName(target).constData()) == 0) {
+        return true;
+    }
+#endif
+
+    // Different volume or no hardlink support
+    return allowCopy && QFile::copy(source, target);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QMap>
+#include <QMutex>
+
+// Raw media shared by all projects. Objects are stored once per content hash under
+// <storeDir>/objects and reached through (provider, id, rendition) keys; project
+// raw files are hardlinks to them (copies where linking is not possible). Each
+// object remembers the project paths linked to it, and an object whose links are
+// all gone is removed by collectGarbage(). Safe to use from any thread.
+class MediaStore
+{
+public:
+    static MediaStore& instance();
+
+    static QString makeKey(const QString& provider, int id, const QString& rendition);
+
+    // Links the stored object for key to destPath; false when the key is not stored
+    bool checkout(const QString& key, const QString& destPath, QString* hash = nullptr, qint64* size = nullptr);
+
+    // Records a finished download, already hashed by the downloader, under key
+    bool adopt(const QString& key, const QString& path, const QString& hash, qint64 size);
+
+    // Forgets key, e.g. when its content turned out to be wrong; the object itself
+    // goes with the next collectGarbage() once nothing links to it
+    void evict(const QString& key);
+
+    // Drops references to files that no longer exist and deletes unreferenced
+    // objects. Returns the number of bytes freed.
+    qint64 collectGarbage();
+
+    int refCount(const QString& key);
+
+    // Hardlinks source to target, copying where that is not possible unless allowCopy is false
+    static bool linkFile(const QString& source, const QString& target, bool allowCopy = true);
+
+private:
+    MediaStore();
+    MediaStore(const MediaStore&) = delete;
+    MediaStore& operator=(const MediaStore&) = delete;
+
+    struct Object {
+        QString fileName;  // <hash>.<ext> below objects/
+        qint64 size = 0;
+        QStringList refs;  // Project paths linked to this object
+    };
+
+    QString objectPath(const Object& object) const;
+    void load();
+    void save();
+
+    QMutex m_mutex;
+    QString m_root;
+    QMap<QString, QString> m_keys;     // key -> hash
+    QMap<QString, Object> m_objects;   // hash -> object
+};
@@ -0,0 +1,140 @@
+#include "networkservice.h"
+#include <QCoreApplication>
+#include <QDebug>
+
+#ifndef QT_NO_SSL
+#include <QSslConfiguration>
+#endif
+
+NetworkService& NetworkService::instance()
+{
+    // Owned by the application so the manager goes away before the network stack does
+    static NetworkService* instance = new NetworkService(QCoreApplication::instance());
+    return *instance;
+}
+
+NetworkService::NetworkService(QObject* parent)
+    : QObject(parent)
+    , m_network(this)
+{
+    connect(&m_network, &QNetworkAccessManager::encrypted, this, [this](QNetworkReply* reply) {
+        if (m_sent.contains(reply)) {
+            m_stats.handshakes++;
+        }
+    });
+    connect(&m_network, &QNetworkAccessManager::finished, this, &NetworkService::onFinished);
+}
+
+QStringList NetworkService::knownHosts()
+{
+    return {"api.pexels.com", "images.pexels.com", "videos.pexels.com"};
+}
+
+void NetworkService::prepareRequest(QNetworkRequest& request, BandwidthScheduler::TrafficClass cls)
+{
+    request.setRawHeader("User-Agent", "PexelManager/1.0");
+    request.setAttribute(QNetworkRequest::Http2AllowedAttribute, true);
+
+    switch (cls) {
+    case BandwidthScheduler::Api:
+    case BandwidthScheduler::Preview:
+        request.setPriority(QNetworkRequest::HighPriority);
+        break;
+    case BandwidthScheduler::Thumbnail:
+        request.setPriority(QNetworkRequest::NormalPriority);
+        break;
+    default:
+        request.setPriority(QNetworkRequest::LowPriority);
+        break;
+    }
+}
+
+void NetworkService::get(const QNetworkRequest& request, BandwidthScheduler::TrafficClass cls, QObject* context,
+                         std::function<void(QNetworkReply*)> started)
+{
+    PendingRequest pending;
+    pending.request = request;
+    prepareRequest(pending.request, cls);
+    pending.context = context;
+    pending.started = std::move(started);
+
+    m_queues[cls].enqueue(pending);
+    m_stats.queued++;
+    m_stats.peakQueued = qMax(m_stats.peakQueued, m_stats.queued);
+    dispatch();
+}
+
+void NetworkService::cancelQueued(QObject* context)
+{
+    for (auto& queue : m_queues) {
+        for (auto it = queue.begin(); it != queue.end();) {
+            if (it->context == context) {
+                it = queue.erase(it);
+                m_stats.queued--;
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+void NetworkService::warmUp(const QStringList& hosts)
+{
+#ifndef QT_NO_SSL
+    // Offer h2 so the warmed connection can carry the HTTP/2 requests that follow
+    QSslConfiguration config = QSslConfiguration::defaultConfiguration();
+    config.setAllowedNextProtocols({QSslConfiguration::ALPNProtocolHTTP2, QSslConfiguration::NextProtocolHttp1_1});
+
+    for (const QString& host : hosts) {
+        m_network.connectToHostEncrypted(host, 443, config);
+        m_stats.warmUps++;
+    }
+#else
+    for (const QString& host : hosts) {
+        m_network.connectToHost(host, 80);
+        m_stats.warmUps++;
+    }
+#endif
+}
+
+NetworkService::Stats NetworkService::stats() const
+{
+    return m_stats;
+}
+
+void NetworkService::dispatch()
+{
+    static const BandwidthScheduler::TrafficClass order[] = {
+        BandwidthScheduler::Api, BandwidthScheduler::Preview,
+        BandwidthScheduler::Thumbnail, BandwidthScheduler::Bulk
+    };
+
+    for (auto cls : order) {
+        auto& queue = m_queues[cls];
+        while (!queue.isEmpty() && m_active < MAX_ACTIVE_REQUESTS) {
+            PendingRequest pending = queue.dequeue();
+            m_stats.queued--;
+            if (!pending.context) continue;  // Requester went away while waiting
+
+            m_active++;
+            QNetworkReply* reply = m_network.get(pending.request);
+            m_sent.insert(reply);
+            pending.started(reply);
+        }
+    }
+}
+
+void NetworkService::onFinished(QNetworkReply* reply)
+{
+    // A warm-up connection reports through the manager too, but it is not a request
+    if (!m_sent.remove(reply)) return;
+
+    m_active = qMax(0, m_active - 1);
+    m_stats.requests++;
+    if (reply->attribute(QNetworkRequest::Http2WasUsedAttribute).toBool()) {
+        m_stats.http2Requests++;
+    }
+
+    emit statsChanged();
+    dispatch();
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <QObject>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QPointer>
+#include <QQueue>
+#include <QSet>
+#include <functional>
+#include "bandwidthscheduler.h"
+
+// The GUI thread's single QNetworkAccessManager, shared by search, thumbnails and
+// previews so they use one connection pool, one TLS session cache and HTTP/2 where
+// the server offers it. Requests wait in one queue per traffic class and start in
+// class order (API, preview, thumbnail, bulk) while fewer than MAX_ACTIVE_REQUESTS
+// are in flight. The download engine keeps its own manager on its thread, since a
+// QNetworkAccessManager cannot be shared across threads, but prepares its requests
+// the same way.
+class NetworkService : public QObject
+{
+    Q_OBJECT
+
+public:
+    static NetworkService& instance();
+
+    struct Stats {
+        int requests = 0;        // Finished requests; warm-ups are not requests
+        int handshakes = 0;      // New TLS connections opened by a request
+        int http2Requests = 0;
+        int warmUps = 0;         // Connections opened ahead by warmUp()
+        int queued = 0;          // Waiting right now
+        int peakQueued = 0;
+
+        // Requests that were served on an existing connection, warmed ones included
+        int reusedConnections() const { return qMax(0, requests - handshakes); }
+    };
+
+    // Queues a GET and calls started with the reply once it is sent. Nothing is
+    // called if context is destroyed or cancelQueued(context) runs first.
+    void get(const QNetworkRequest& request, BandwidthScheduler::TrafficClass cls, QObject* context,
+             std::function<void(QNetworkReply*)> started);
+
+    // Drops the requests of context that have not been sent yet
+    void cancelQueued(QObject* context);
+
+    // Opens TLS connections ahead of the first request
+    void warmUp(const QStringList& hosts);
+
+    Stats stats() const;
+
+    // Hosts the application talks to
+    static QStringList knownHosts();
+
+    // HTTP/2, user agent and a priority matching the traffic class
+    static void prepareRequest(QNetworkRequest& request, BandwidthScheduler::TrafficClass cls);
+
+    static const int MAX_ACTIVE_REQUESTS = 12;
+
+signals:
+    void statsChanged();
+
+private:
+    explicit NetworkService(QObject* parent = nullptr);
+
+    struct PendingRequest {
+        QNetworkRequest request;
+        QPointer<QObject> context;
+        std::function<void(QNetworkReply*)> started;
+    };
+
+    void dispatch();
+    void onFinished(QNetworkReply* reply);
+
+    QNetworkAccessManager m_network;
+    QQueue<PendingRequest> m_queues[BandwidthScheduler::ClassCount];
+    int m_active = 0;
+    QSet<QNetworkReply*> m_sent;  // Replies of get(); the manager's other replies are warm-ups
+    Stats m_stats;
+};
@@ -1,9 +1,13 @@
 #include "pexelsapi.h"
 #include "settings.h"
+#include "bandwidthscheduler.h"
+#include "networkservice.h"
+#include "allocationcounter.h"
 #include <QUrlQuery>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QDebug>
 
 PexelsApi::PexelsApi(QObject* parent)
     : QObject(parent)
@@ -53,14 +57,21 @@ void PexelsApi::search(const QString& query, SearchType type, int page, int perP
     QNetworkRequest request(url);
     request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
     request.setRawHeader("Authorization", apiKey.toUtf8());
-    request.setRawHeader("User-Agent", "PexelManager/1.0");
 
-    m_currentReply = m_network.get(request);
-    connect(m_currentReply, &QNetworkReply::finished, this, &PexelsApi::onSearchFinished);
+    m_searchQueued = true;
+    NetworkService::instance().get(request, BandwidthScheduler::Api, this, [this](QNetworkReply* reply) {
+        m_searchQueued = false;
+        m_currentReply = reply;
+        connect(m_currentReply, &QNetworkReply::finished, this, &PexelsApi::onSearchFinished);
+    });
 }
 
 void PexelsApi::cancelSearch()
 {
+    if (m_searchQueued) {
+        NetworkService::instance().cancelQueued(this);
+        m_searchQueued = false;
+    }
     if (m_currentReply) {
         m_currentReply->abort();
         m_currentReply->deleteLater();
@@ -85,9 +96,14 @@ void PexelsApi::onSearchFinished()
 
     QByteArray data = reply->readAll();
     reply->deleteLater();
+    BandwidthScheduler::instance().consume(BandwidthScheduler::Api, data.size());
 
+    quint64 allocationsBefore = AllocationCounter::count();
     QJsonParseError parseError;
     QJsonDocument doc = QJsonDocument::fromJson(data, &parseError);
+    if (AllocationCounter::enabled()) {
+        qDebug() << "Search page parse:" << AllocationCounter::count() - allocationsBefore << "allocations";
+    }
     if (parseError.error != QJsonParseError::NoError) {
         emit searchError(QString("JSON parse error: %1").arg(parseError.errorString()));
         return;
@@ -97,19 +113,15 @@ void PexelsApi::onSearchFinished()
     int totalResults = root["total_results"].toInt();
     int page = root["page"].toInt();
 
-    QList<MediaMetadata> media;
-
+    // Items are decoded lazily by the consumer, only for results that survive filtering
+    SearchPage results;
     if (m_currentSearchType == SearchType::Videos) {
-        QJsonArray videosArray = root["videos"].toArray();
-        for (const auto& v : videosArray) {
-            media.append(MediaMetadata::fromPexelsVideoJson(v.toObject()));
-        }
+        results.type = MediaType::Video;
+        results.items = root["videos"].toArray();
     } else {
-        QJsonArray photosArray = root["photos"].toArray();
-        for (const auto& p : photosArray) {
-            media.append(MediaMetadata::fromPexelsPhotoJson(p.toObject()));
-        }
+        results.type = MediaType::Image;
+        results.items = root["photos"].toArray();
     }
 
-    emit searchCompleted(media, totalResults, page);
+    emit searchCompleted(results, totalResults, page);
 }
@@ -1,7 +1,6 @@
 #pragma once
 
 #include <QObject>
-#include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include "mediametadata.h"
 
@@ -22,17 +21,17 @@ public:
     void searchPhotos(const QString& query, int page = 1, int perPage = 20);
     void cancelSearch();
 
-    bool isSearching() const { return m_currentReply != nullptr; }
+    bool isSearching() const { return m_currentReply != nullptr || m_searchQueued; }
 
 signals:
-    void searchCompleted(const QList<MediaMetadata>& media, int totalResults, int page);
+    void searchCompleted(const SearchPage& results, int totalResults, int page);
     void searchError(const QString& error);
 
 private slots:
     void onSearchFinished();
 
 private:
-    QNetworkAccessManager m_network;
     QNetworkReply* m_currentReply = nullptr;
+    bool m_searchQueued = false;  // Waiting for a free slot in the network service
     SearchType m_currentSearchType = SearchType::Videos;
 };
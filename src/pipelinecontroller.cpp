@@ -0,0 +1,97 @@
+#include "pipelinecontroller.h"
+#include <QDebug>
+
+PipelineController::PipelineController(QObject* parent)
+    : QObject(parent)
+{
+}
+
+void PipelineController::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+    if (!enabled) {
+        clear();
+    }
+}
+
+void PipelineController::setStageLimits(int maxScales, int maxUploads)
+{
+    m_maxScales = qMax(1, maxScales);
+    m_maxUploads = qMax(1, maxUploads);
+    dispatch();
+}
+
+void PipelineController::downloadFinished(int mediaId)
+{
+    if (!m_enabled) return;
+    m_scaleBacklog.enqueue(mediaId);
+    dispatch();
+}
+
+void PipelineController::scaleFinished(int mediaId)
+{
+    if (!m_enabled) return;
+    m_uploadBacklog.enqueue(mediaId);
+    dispatch();
+}
+
+void PipelineController::scaleDone(int mediaId)
+{
+    if (!m_scaling.remove(mediaId)) return;
+    dispatch();
+}
+
+void PipelineController::uploadDone(int mediaId)
+{
+    if (!m_uploading.remove(mediaId)) return;
+    dispatch();
+}
+
+void PipelineController::clear()
+{
+    m_scaleBacklog.clear();
+    m_uploadBacklog.clear();
+    m_scaling.clear();
+    m_uploading.clear();
+    if (m_downloadsPaused) {
+        m_downloadsPaused = false;
+        emit downloadsPausedChanged(false);
+    }
+}
+
+bool PipelineController::isIdle() const
+{
+    return m_scaleBacklog.isEmpty() && m_uploadBacklog.isEmpty() && m_scaling.isEmpty() && m_uploading.isEmpty();
+}
+
+void PipelineController::dispatch()
+{
+    // Uploads first: they free the backlog that gates scaling
+    while (!m_uploadBacklog.isEmpty() && m_uploading.size() < m_maxUploads) {
+        int mediaId = m_uploadBacklog.dequeue();
+        m_uploading.insert(mediaId);
+        emit startUpload(mediaId);
+    }
+
+    bool uploadsFull = m_uploadBacklog.size() >= UPLOAD_BACKLOG_LIMIT;
+    while (!uploadsFull && !m_scaleBacklog.isEmpty() && m_scaling.size() < m_maxScales) {
+        int mediaId = m_scaleBacklog.dequeue();
+        m_scaling.insert(mediaId);
+        emit startScale(mediaId);
+    }
+
+    // Pause with hysteresis so downloads do not flap around the limit
+    bool pause = m_downloadsPaused
+        ? m_scaleBacklog.size() > SCALE_BACKLOG_LIMIT / 2
+        : m_scaleBacklog.size() >= SCALE_BACKLOG_LIMIT;
+    if (pause != m_downloadsPaused) {
+        m_downloadsPaused = pause;
+        qDebug() << "Pipeline:" << (pause ? "pausing" : "resuming") << "downloads, scale backlog"
+                 << m_scaleBacklog.size();
+        emit downloadsPausedChanged(pause);
+    }
+
+    if (isIdle()) {
+        emit drained();
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QObject>
+#include <QQueue>
+#include <QSet>
+
+// Chains download -> scale -> upload per item so network and CPU work overlap.
+// Items wait in bounded queues between the stages: at most maxScales/maxUploads
+// jobs are handed out at a time, a full upload backlog stops new scale jobs, and
+// a full scale backlog asks for downloads to pause until it has drained.
+class PipelineController : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PipelineController(QObject* parent = nullptr);
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return m_enabled; }
+
+    void setStageLimits(int maxScales, int maxUploads);
+
+    // Stage results; each item moves on to the next stage's queue
+    void downloadFinished(int mediaId);
+    void scaleFinished(int mediaId);
+
+    // A started job ended, successfully or not
+    void scaleDone(int mediaId);
+    void uploadDone(int mediaId);
+
+    void clear();
+
+    bool isIdle() const;
+    bool downloadsPaused() const { return m_downloadsPaused; }
+
+    static const int SCALE_BACKLOG_LIMIT = 16;
+    static const int UPLOAD_BACKLOG_LIMIT = 16;
+
+signals:
+    void startScale(int mediaId);
+    void startUpload(int mediaId);
+    void downloadsPausedChanged(bool paused);
+    void drained();
+
+private:
+    void dispatch();
+
+    bool m_enabled = false;
+    int m_maxScales = 4;
+    int m_maxUploads = 4;
+
+    QQueue<int> m_scaleBacklog;
+    QQueue<int> m_uploadBacklog;
+    QSet<int> m_scaling;
+    QSet<int> m_uploading;
+    bool m_downloadsPaused = false;
+};
@@ -16,6 +16,34 @@ QString Project::scaledDir() const
     return path + "/scaled";
 }
 
+QList<Rendition> Project::outputRenditions() const
+{
+    if (!renditions.isEmpty()) return renditions;
+
+    auto& settings = Settings::instance();
+    Rendition target;
+    target.name = QString("%1x%2").arg(settings.targetWidth()).arg(settings.targetHeight());
+    target.width = settings.targetWidth();
+    target.height = settings.targetHeight();
+    return {target};
+}
+
+QString Project::renditionPath(const QString& baseName, const QString& extension, int index) const
+{
+    auto& settings = Settings::instance();
+    Rendition rendition = outputRenditions().value(index);
+    bool defaultCrf = rendition.crf == 0 || rendition.crf == settings.ffmpegCrf();
+    if (rendition.width == settings.targetWidth() && rendition.height == settings.targetHeight() && defaultCrf) {
+        return scaledDir() + "/" + baseName + extension;
+    }
+
+    QString suffix = QString("_%1x%2").arg(rendition.width).arg(rendition.height);
+    if (!defaultCrf) {
+        suffix += QString("_crf%1").arg(rendition.crf);
+    }
+    return scaledDir() + "/" + baseName + suffix + extension;
+}
+
 ProjectManager::ProjectManager(QObject* parent)
     : QObject(parent)
 {
@@ -75,6 +103,9 @@ bool ProjectManager::loadProject(const QString& path)
     m_project.path = path;
     m_project.searchQuery = root["search_query"].toString();
     m_project.minDuration = root["min_duration"].toInt(30);
+    for (const auto& r : root["renditions"].toArray()) {
+        m_project.renditions.append(Rendition::fromJson(r.toObject()));
+    }
 
     // Check format version (v2 = new format, v1/missing = old format)
     int version = root["version"].toInt(1);
@@ -152,6 +183,12 @@ bool ProjectManager::saveProject()
     root["search_query"] = m_project.searchQuery;
     root["min_duration"] = m_project.minDuration;
 
+    QJsonArray renditionArray;
+    for (const auto& rendition : m_project.renditions) {
+        renditionArray.append(rendition.toJson());
+    }
+    root["renditions"] = renditionArray;
+
     // Save rejected IDs
     QJsonArray rejectedArray;
     for (int id : m_project.rejectedIds) {
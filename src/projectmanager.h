@@ -15,8 +15,20 @@ struct Project {
     QList<MediaMetadata> media;
     QSet<int> rejectedIds;
 
+    // Output sizes, all encoded from one decode of the source. Empty means the
+    // single configured target size.
+    QList<Rendition> renditions;
+
     QString rawDir() const;
     QString scaledDir() const;
+
+    // The renditions to produce: renditions, or the configured target size
+    QList<Rendition> outputRenditions() const;
+
+    // Scaled file of rendition index. Projects share the bucket's media/ prefix, so the
+    // name comes from the output itself (_WxH, plus _crfN for a CRF of its own); only
+    // the configured target size keeps the plain name used before ladders existed.
+    QString renditionPath(const QString& baseName, const QString& extension, int index) const;
 };
 
 class ProjectManager : public QObject
@@ -0,0 +1,642 @@
+#include "s3client.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QCryptographicHash>
+#include <QMessageAuthenticationCode>
+#include <QXmlStreamReader>
+#include <QTextStream>
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+
+const QByteArray UNSIGNED_PAYLOAD = "UNSIGNED-PAYLOAD";
+
+// A byte range of a file, read on demand so a part never sits in memory
+class FileRange : public QIODevice
+{
+public:
+    FileRange(const QString& path, qint64 offset, qint64 length)
+        : m_file(path), m_offset(offset), m_length(length) {}
+
+    bool open(OpenMode mode) override
+    {
+        if (!m_file.open(QIODevice::ReadOnly) || !m_file.seek(m_offset)) return false;
+        return QIODevice::open(mode | QIODevice::Unbuffered);
+    }
+
+    void close() override
+    {
+        m_file.close();
+        QIODevice::close();
+    }
+
+    bool isSequential() const override { return false; }
+    qint64 size() const override { return m_length; }
+
+    bool seek(qint64 pos) override
+    {
+        if (pos > m_length || !QIODevice::seek(pos)) return false;
+        return m_file.seek(m_offset + pos);
+    }
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override
+    {
+        qint64 remaining = m_offset + m_length - m_file.pos();
+        if (remaining <= 0) return -1;
+        return m_file.read(data, qMin(maxSize, remaining));
+    }
+
+    qint64 writeData(const char*, qint64) override { return -1; }
+
+private:
+    QFile m_file;
+    qint64 m_offset;
+    qint64 m_length;
+};
+
+// Sections of an AWS INI file; "[profile x]" headers in the config file become "x"
+QMap<QString, QMap<QString, QString>> readIni(const QString& path)
+{
+    QMap<QString, QMap<QString, QString>> sections;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) return sections;
+
+    QString section;
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+        QString line = in.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#') || line.startsWith(';')) continue;
+
+        if (line.startsWith('[') && line.endsWith(']')) {
+            section = line.mid(1, line.size() - 2).trimmed();
+            if (section.startsWith("profile ")) {
+                section = section.mid(8).trimmed();
+            }
+            continue;
+        }
+
+        int eq = line.indexOf('=');
+        if (eq > 0) {
+            sections[section][line.left(eq).trimmed()] = line.mid(eq + 1).trimmed();
+        }
+    }
+    return sections;
+}
+
+QByteArray hmac(const QByteArray& key, const QByteArray& message)
+{
+    return QMessageAuthenticationCode::hash(message, key, QCryptographicHash::Sha256);
+}
+
+QByteArray sha256Hex(const QByteArray& data)
+{
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha256).toHex();
+}
+
+// Query parameters sorted by name, each with an "=", as SigV4 requires
+QByteArray canonicalQuery(const QUrl& url)
+{
+    QList<QByteArray> params = url.query(QUrl::FullyEncoded).toUtf8().split('&');
+    params.removeAll(QByteArray());
+    for (auto& param : params) {
+        if (!param.contains('=')) {
+            param += '=';
+        }
+    }
+    std::sort(params.begin(), params.end());
+    return params.join('&');
+}
+
+} // namespace
+
+S3Config S3Config::fromProfile(const QString& profile)
+{
+    S3Config config;
+    QString name = profile.isEmpty() ? QString("default") : profile;
+    QString awsDir = QDir::homePath() + "/.aws";
+
+    QString credentialsPath = qEnvironmentVariable("AWS_SHARED_CREDENTIALS_FILE", awsDir + "/credentials");
+    QString configPath = qEnvironmentVariable("AWS_CONFIG_FILE", awsDir + "/config");
+    auto credentials = readIni(credentialsPath).value(name);
+    auto settings = readIni(configPath).value(name);
+
+    if (name == "default" && qEnvironmentVariableIsSet("AWS_ACCESS_KEY_ID")) {
+        config.accessKey = qEnvironmentVariable("AWS_ACCESS_KEY_ID");
+        config.secretKey = qEnvironmentVariable("AWS_SECRET_ACCESS_KEY");
+        config.sessionToken = qEnvironmentVariable("AWS_SESSION_TOKEN");
+    } else {
+        // Keys may also sit in the config file
+        config.accessKey = credentials.value("aws_access_key_id", settings.value("aws_access_key_id"));
+        config.secretKey = credentials.value("aws_secret_access_key", settings.value("aws_secret_access_key"));
+        config.sessionToken = credentials.value("aws_session_token", settings.value("aws_session_token"));
+    }
+
+    QString region = qEnvironmentVariable("AWS_REGION", qEnvironmentVariable("AWS_DEFAULT_REGION"));
+    if (region.isEmpty()) {
+        region = settings.value("region");
+    }
+    if (!region.isEmpty()) {
+        config.region = region;
+    }
+
+    config.endpoint = qEnvironmentVariable("AWS_ENDPOINT_URL", settings.value("endpoint_url"));
+    return config;
+}
+
+S3Client::S3Client(QObject* parent)
+    : QObject(parent)
+    , m_network(this)
+{
+}
+
+QString S3Client::uploadIdQuery(const QString& uploadId)
+{
+    // Upload ids may contain +, / and =, which SigV4 expects percent-encoded
+    return "uploadId=" + QString::fromUtf8(QUrl::toPercentEncoding(uploadId));
+}
+
+QUrl S3Client::objectUrl(const QString& bucket, const QString& key, const QString& query) const
+{
+    QByteArray path = QUrl::toPercentEncoding(key, "/~");
+
+    QByteArray url;
+    if (!m_config.endpoint.isEmpty()) {
+        // Stand-ins rarely have wildcard DNS, so address the bucket in the path
+        QByteArray base = m_config.endpoint.toUtf8();
+        while (base.endsWith('/')) base.chop(1);
+        url = base + "/" + QUrl::toPercentEncoding(bucket);
+        if (!key.isEmpty()) {
+            url += "/" + path;
+        }
+    } else {
+        url = QString("https://%1.s3.%2.amazonaws.com/").arg(bucket, m_config.region).toUtf8() + path;
+    }
+    if (!query.isEmpty()) {
+        url += "?" + query.toUtf8();
+    }
+    return QUrl::fromEncoded(url);
+}
+
+void S3Client::signRequest(QNetworkRequest& request, const QByteArray& method, const QByteArray& payloadHash) const
+{
+    QDateTime now = QDateTime::currentDateTimeUtc();
+    QByteArray amzDate = now.toString("yyyyMMdd'T'HHmmss'Z'").toUtf8();
+    QByteArray date = amzDate.left(8);
+
+    QUrl url = request.url();
+    QByteArray host = url.host(QUrl::FullyEncoded).toUtf8();
+    if (url.port() != -1) {
+        host += ":" + QByteArray::number(url.port());
+    }
+
+    request.setRawHeader("x-amz-date", amzDate);
+    request.setRawHeader("x-amz-content-sha256", payloadHash);
+
+    QByteArray headers = "host:" + host + "\n"
+        + "x-amz-content-sha256:" + payloadHash + "\n"
+        + "x-amz-date:" + amzDate + "\n";
+    QByteArray signedHeaders = "host;x-amz-content-sha256;x-amz-date";
+    if (!m_config.sessionToken.isEmpty()) {
+        request.setRawHeader("x-amz-security-token", m_config.sessionToken.toUtf8());
+        headers += "x-amz-security-token:" + m_config.sessionToken.toUtf8() + "\n";
+        signedHeaders += ";x-amz-security-token";
+    }
+
+    QByteArray path = url.path(QUrl::FullyEncoded).toUtf8();
+    if (path.isEmpty()) path = "/";
+
+    QByteArray canonicalRequest = method + "\n" + path + "\n" + canonicalQuery(url) + "\n"
+        + headers + "\n" + signedHeaders + "\n" + payloadHash;
+
+    QByteArray scope = date + "/" + m_config.region.toUtf8() + "/s3/aws4_request";
+    QByteArray stringToSign = "AWS4-HMAC-SHA256\n" + amzDate + "\n" + scope + "\n" + sha256Hex(canonicalRequest);
+
+    QByteArray key = hmac("AWS4" + m_config.secretKey.toUtf8(), date);
+    key = hmac(key, m_config.region.toUtf8());
+    key = hmac(key, "s3");
+    key = hmac(key, "aws4_request");
+    QByteArray signature = hmac(key, stringToSign).toHex();
+
+    request.setRawHeader("Authorization", "AWS4-HMAC-SHA256 Credential=" + m_config.accessKey.toUtf8() + "/" + scope
+                         + ", SignedHeaders=" + signedHeaders + ", Signature=" + signature);
+}
+
+QNetworkReply* S3Client::send(const QByteArray& method, const QUrl& url, QIODevice* body, qint64 size,
+                              const QByteArray& payloadHash, const QByteArray& contentType)
+{
+    QNetworkRequest request(url);
+    request.setRawHeader("User-Agent", "PexelManager/1.0");
+    request.setAttribute(QNetworkRequest::Http2AllowedAttribute, true);
+    if (body) {
+        request.setHeader(QNetworkRequest::ContentLengthHeader, size);
+    }
+    if (!contentType.isEmpty()) {
+        request.setHeader(QNetworkRequest::ContentTypeHeader, contentType);
+    }
+    signRequest(request, method, payloadHash);
+
+    QNetworkReply* reply = m_network.sendCustomRequest(request, method, body);
+    if (body) {
+        body->setParent(reply);
+    }
+    return reply;
+}
+
+QNetworkReply* S3Client::sendData(const QByteArray& method, const QUrl& url, const QByteArray& data,
+                                  const QByteArray& contentType)
+{
+    QNetworkRequest request(url);
+    request.setRawHeader("User-Agent", "PexelManager/1.0");
+    request.setAttribute(QNetworkRequest::Http2AllowedAttribute, true);
+    if (!contentType.isEmpty()) {
+        request.setHeader(QNetworkRequest::ContentTypeHeader, contentType);
+    }
+    signRequest(request, method, sha256Hex(data));
+    return m_network.sendCustomRequest(request, method, data);
+}
+
+int S3Client::putObject(const QString& bucket, const QString& key, const QString& localPath)
+{
+    int id = m_nextId++;
+
+    Operation op;
+    op.bucket = bucket;
+    op.key = key;
+    op.localPath = localPath;
+    op.size = QFileInfo(localPath).size();
+    m_operations.insert(id, op);
+
+    if (!QFileInfo::exists(localPath)) {
+        finishOperation(id, QString("File not found: %1").arg(localPath));
+    } else if (op.size >= MULTIPART_THRESHOLD) {
+        startMultipart(id);
+    } else {
+        startSinglePut(id);
+    }
+    return id;
+}
+
+int S3Client::deleteObject(const QString& bucket, const QString& key)
+{
+    int id = m_nextId++;
+
+    Operation op;
+    op.bucket = bucket;
+    op.key = key;
+    m_operations.insert(id, op);
+
+    QNetworkReply* reply = sendData("DELETE", objectUrl(bucket, key), QByteArray());
+    m_operations[id].replies.append(reply);
+    connect(reply, &QNetworkReply::finished, this, [this, id, reply]() {
+        QByteArray body = reply->readAll();
+        if (m_operations.contains(id)) {
+            m_operations[id].replies.removeOne(reply);
+        }
+        reply->deleteLater();
+        finishOperation(id, replyError(reply, body));
+    });
+    return id;
+}
+
+int S3Client::listObjects(const QString& bucket, const QString& prefix,
+                          const QString& startAfter, const QString& lastKey)
+{
+    int id = m_nextId++;
+
+    Operation op;
+    op.bucket = bucket;
+    op.prefix = prefix;
+    op.startAfter = startAfter;
+    op.lastKey = lastKey;
+    op.listing = true;
+    m_operations.insert(id, op);
+
+    requestListPage(id, QString());
+    return id;
+}
+
+void S3Client::requestListPage(int id, const QString& continuationToken)
+{
+    Operation& op = m_operations[id];
+
+    QString query = "list-type=2";
+    if (!op.prefix.isEmpty()) {
+        query += "&prefix=" + QString::fromUtf8(QUrl::toPercentEncoding(op.prefix));
+    }
+    if (!continuationToken.isEmpty()) {
+        query += "&continuation-token=" + QString::fromUtf8(QUrl::toPercentEncoding(continuationToken));
+    } else if (!op.startAfter.isEmpty()) {
+        query += "&start-after=" + QString::fromUtf8(QUrl::toPercentEncoding(op.startAfter));
+    }
+
+    QNetworkReply* reply = sendData("GET", objectUrl(op.bucket, QString(), query), QByteArray());
+    op.replies.append(reply);
+    connect(reply, &QNetworkReply::finished, this, [this, id, reply]() {
+        QByteArray body = reply->readAll();
+        reply->deleteLater();
+        if (!m_operations.contains(id)) return;
+
+        Operation& op = m_operations[id];
+        op.replies.removeOne(reply);
+
+        QString error = replyError(reply, body);
+        if (!error.isEmpty()) {
+            finishOperation(id, error);
+            return;
+        }
+
+        bool truncated = false;
+        bool pastEnd = false;
+        QString nextToken;
+        QXmlStreamReader reader(body);
+        S3Object object;
+        while (!reader.atEnd()) {
+            reader.readNext();
+            if (reader.isStartElement()) {
+                auto name = reader.name();
+                if (name == QLatin1String("Contents")) {
+                    object = S3Object();
+                } else if (name == QLatin1String("Key")) {
+                    object.key = reader.readElementText();
+                } else if (name == QLatin1String("Size")) {
+                    object.size = reader.readElementText().toLongLong();
+                } else if (name == QLatin1String("ETag")) {
+                    object.etag = reader.readElementText().remove('"');
+                } else if (name == QLatin1String("LastModified")) {
+                    object.lastModified = QDateTime::fromString(reader.readElementText(), Qt::ISODateWithMs);
+                } else if (name == QLatin1String("IsTruncated")) {
+                    truncated = reader.readElementText() == "true";
+                } else if (name == QLatin1String("NextContinuationToken")) {
+                    nextToken = reader.readElementText();
+                }
+            } else if (reader.isEndElement() && reader.name() == QLatin1String("Contents")) {
+                // Keys come back in UTF-8 binary order, which QByteArray comparison matches
+                if (!op.lastKey.isEmpty() && object.key.toUtf8() > op.lastKey.toUtf8()) {
+                    pastEnd = true;
+                } else {
+                    op.objects.append(object);
+                }
+            }
+        }
+
+        if (truncated && !pastEnd && !nextToken.isEmpty()) {
+            requestListPage(id, nextToken);
+        } else {
+            finishOperation(id, QString());
+        }
+    });
+}
+
+void S3Client::abortAll()
+{
+    for (auto& op : m_operations) {
+        for (auto reply : op.replies) {
+            reply->disconnect(this);
+            reply->abort();
+            reply->deleteLater();
+        }
+        // Parts already stored are cleaned up by the bucket's lifecycle rule, if any
+        if (!op.uploadId.isEmpty()) {
+            QNetworkReply* reply = sendData("DELETE", objectUrl(op.bucket, op.key, uploadIdQuery(op.uploadId)));
+            connect(reply, &QNetworkReply::finished, reply, &QObject::deleteLater);
+        }
+    }
+    m_operations.clear();
+}
+
+void S3Client::startSinglePut(int id)
+{
+    Operation& op = m_operations[id];
+
+    auto file = new QFile(op.localPath);
+    if (!file->open(QIODevice::ReadOnly)) {
+        delete file;
+        finishOperation(id, QString("Cannot read %1").arg(op.localPath));
+        return;
+    }
+
+    QNetworkReply* reply = send("PUT", objectUrl(op.bucket, op.key), file, op.size, UNSIGNED_PAYLOAD,
+                                contentTypeFor(op.localPath));
+    op.replies.append(reply);
+    connect(reply, &QNetworkReply::finished, this, [this, id, reply]() {
+        QByteArray body = reply->readAll();
+        if (m_operations.contains(id)) {
+            m_operations[id].replies.removeOne(reply);
+            m_operations[id].etag = QString::fromUtf8(reply->rawHeader("ETag"));
+        }
+        reply->deleteLater();
+        finishOperation(id, replyError(reply, body));
+    });
+}
+
+void S3Client::startMultipart(int id)
+{
+    Operation& op = m_operations[id];
+    op.partCount = int((op.size + PART_SIZE - 1) / PART_SIZE);
+
+    QNetworkReply* reply = sendData("POST", objectUrl(op.bucket, op.key, "uploads"), QByteArray(),
+                                    contentTypeFor(op.localPath));
+    op.replies.append(reply);
+    connect(reply, &QNetworkReply::finished, this, [this, id, reply]() {
+        QByteArray body = reply->readAll();
+        reply->deleteLater();
+        if (!m_operations.contains(id)) return;
+
+        Operation& op = m_operations[id];
+        op.replies.removeOne(reply);
+
+        QString error = replyError(reply, body);
+        if (error.isEmpty()) {
+            op.uploadId = xmlValue(body, "UploadId");
+            if (op.uploadId.isEmpty()) {
+                error = "No UploadId in CreateMultipartUpload response";
+            }
+        }
+        if (!error.isEmpty()) {
+            finishOperation(id, error);
+            return;
+        }
+
+        qDebug() << "S3 multipart upload of" << op.key << "in" << op.partCount << "parts";
+        startParts(id);
+    });
+}
+
+void S3Client::startParts(int id)
+{
+    Operation& op = m_operations[id];
+
+    while (op.replies.size() < MAX_PARALLEL_PARTS) {
+        int partNumber;
+        if (!op.retryParts.isEmpty()) {
+            partNumber = op.retryParts.takeFirst();
+        } else if (op.nextPart <= op.partCount) {
+            partNumber = op.nextPart++;
+        } else {
+            break;
+        }
+
+        qint64 offset = (partNumber - 1) * PART_SIZE;
+        qint64 length = qMin(PART_SIZE, op.size - offset);
+
+        auto range = new FileRange(op.localPath, offset, length);
+        if (!range->open(QIODevice::ReadOnly)) {
+            delete range;
+            finishOperation(id, QString("Cannot read %1").arg(op.localPath));
+            return;
+        }
+
+        QString query = QString("partNumber=%1&").arg(partNumber) + uploadIdQuery(op.uploadId);
+        QNetworkReply* reply = send("PUT", objectUrl(op.bucket, op.key, query), range, length, UNSIGNED_PAYLOAD);
+        op.replies.append(reply);
+        op.attempts[partNumber]++;
+        connect(reply, &QNetworkReply::finished, this, [this, id, partNumber, reply]() {
+            onPartFinished(id, partNumber, reply);
+        });
+    }
+}
+
+void S3Client::onPartFinished(int id, int partNumber, QNetworkReply* reply)
+{
+    QByteArray body = reply->readAll();
+    reply->deleteLater();
+    if (!m_operations.contains(id)) return;
+
+    Operation& op = m_operations[id];
+    op.replies.removeOne(reply);
+
+    QString error = replyError(reply, body);
+    if (!error.isEmpty()) {
+        int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        bool transient = status == 0 || status >= 500;
+        if (transient && op.attempts.value(partNumber) < MAX_PART_ATTEMPTS) {
+            qDebug() << "S3 part" << partNumber << "of" << op.key << "failed, retrying:" << error;
+            op.retryParts.append(partNumber);
+            startParts(id);
+            return;
+        }
+        finishOperation(id, QString("Part %1: %2").arg(partNumber).arg(error));
+        return;
+    }
+
+    op.etags[partNumber] = QString::fromUtf8(reply->rawHeader("ETag"));
+    op.partsDone++;
+
+    if (op.partsDone == op.partCount) {
+        completeMultipart(id);
+    } else {
+        startParts(id);
+    }
+}
+
+void S3Client::completeMultipart(int id)
+{
+    Operation& op = m_operations[id];
+
+    QByteArray xml = "<CompleteMultipartUpload>";
+    for (auto it = op.etags.constBegin(); it != op.etags.constEnd(); ++it) {
+        xml += "<Part><PartNumber>" + QByteArray::number(it.key()) + "</PartNumber><ETag>"
+            + it.value().toHtmlEscaped().toUtf8() + "</ETag></Part>";
+    }
+    xml += "</CompleteMultipartUpload>";
+
+    QString query = uploadIdQuery(op.uploadId);
+    QNetworkReply* reply = sendData("POST", objectUrl(op.bucket, op.key, query), xml, "application/xml");
+    op.replies.append(reply);
+    connect(reply, &QNetworkReply::finished, this, [this, id, reply]() {
+        QByteArray body = reply->readAll();
+        reply->deleteLater();
+        if (!m_operations.contains(id)) return;
+
+        Operation& op = m_operations[id];
+        op.replies.removeOne(reply);
+
+        // S3 can answer 200 and still report an error in the body
+        QString error = replyError(reply, body);
+        if (error.isEmpty() && body.contains("<Error>")) {
+            error = xmlValue(body, "Message");
+        }
+        if (error.isEmpty()) {
+            op.uploadId.clear();
+            op.etag = xmlValue(body, "ETag");
+        }
+        finishOperation(id, error);
+    });
+}
+
+void S3Client::finishOperation(int id, const QString& error)
+{
+    if (!m_operations.contains(id)) return;
+    Operation op = m_operations.take(id);
+
+    for (auto reply : op.replies) {
+        reply->disconnect(this);
+        reply->abort();
+        reply->deleteLater();
+    }
+
+    // Free the stored parts of a failed multipart upload
+    if (!op.uploadId.isEmpty()) {
+        QString query = uploadIdQuery(op.uploadId);
+        QNetworkReply* reply = sendData("DELETE", objectUrl(op.bucket, op.key, query));
+        connect(reply, &QNetworkReply::finished, reply, &QObject::deleteLater);
+    }
+
+    if (!error.isEmpty()) {
+        qDebug() << "S3 request for" << op.key << "failed:" << error;
+    }
+    // Queued, so even an immediate failure reaches the caller after it has stored the id
+    QString etag = op.etag;
+    etag.remove('"');
+    QList<S3Object> objects = op.objects;
+    bool listing = op.listing;
+    QMetaObject::invokeMethod(this, [this, id, error, etag, objects, listing]() {
+        if (listing) {
+            emit listFinished(id, objects, error);
+        } else {
+            emit requestFinished(id, error, etag);
+        }
+    }, Qt::QueuedConnection);
+}
+
+QString S3Client::replyError(QNetworkReply* reply, const QByteArray& body)
+{
+    if (reply->error() == QNetworkReply::NoError) return QString();
+
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    if (status == 0) {
+        return reply->errorString();
+    }
+
+    QString code = xmlValue(body, "Code");
+    QString message = xmlValue(body, "Message");
+    if (code.isEmpty()) {
+        return QString("HTTP %1").arg(status);
+    }
+    return QString("HTTP %1 %2: %3").arg(status).arg(code, message);
+}
+
+QString S3Client::xmlValue(const QByteArray& xml, const QString& element)
+{
+    QXmlStreamReader reader(xml);
+    while (!reader.atEnd()) {
+        if (reader.readNext() == QXmlStreamReader::StartElement && reader.name() == element) {
+            return reader.readElementText();
+        }
+    }
+    return QString();
+}
+
+QByteArray S3Client::contentTypeFor(const QString& path)
+{
+    QString suffix = QFileInfo(path).suffix().toLower();
+    if (suffix == "mp4") return "video/mp4";
+    if (suffix == "jpg" || suffix == "jpeg") return "image/jpeg";
+    if (suffix == "png") return "image/png";
+    if (suffix == "json") return "application/json";
+    return "application/octet-stream";
+}
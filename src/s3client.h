@@ -0,0 +1,121 @@
+#pragma once
+
+#include <QObject>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QMap>
+#include <QDateTime>
+
+// Credentials and endpoint for one AWS profile
+struct S3Config {
+    QString accessKey;
+    QString secretKey;
+    QString sessionToken;
+    QString region = "us-east-1";
+    QString endpoint;  // S3-compatible server (e.g. a local MinIO), addressed path-style; empty for AWS
+
+    bool isValid() const { return !accessKey.isEmpty() && !secretKey.isEmpty(); }
+
+    // Resolves like the aws CLI: a named profile from ~/.aws/credentials and ~/.aws/config,
+    // or for the default profile the AWS_* environment variables first
+    static S3Config fromProfile(const QString& profile);
+};
+
+// One entry of a bucket listing
+struct S3Object {
+    QString key;
+    qint64 size = 0;
+    QString etag;  // Without quotes
+    QDateTime lastModified;
+};
+
+// In-process S3 client signing requests with SigV4. Files are streamed from disk,
+// never loaded whole; files of MULTIPART_THRESHOLD and up are sent as a multipart
+// upload with up to MAX_PARALLEL_PARTS parts in flight.
+class S3Client : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit S3Client(QObject* parent = nullptr);
+
+    void setConfig(const S3Config& config) { m_config = config; }
+    const S3Config& config() const { return m_config; }
+
+    // Start an operation and return its id for requestFinished
+    int putObject(const QString& bucket, const QString& key, const QString& localPath);
+    int deleteObject(const QString& bucket, const QString& key);
+
+    // Lists the objects under prefix, following continuation tokens; reported by listFinished.
+    // startAfter and lastKey (both optional) limit it to the key range (startAfter, lastKey].
+    int listObjects(const QString& bucket, const QString& prefix,
+                    const QString& startAfter = QString(), const QString& lastKey = QString());
+
+    void abortAll();
+
+    // URL of an object (or the bucket for an empty key); query is "name=value&..." already encoded
+    QUrl objectUrl(const QString& bucket, const QString& key, const QString& query = QString()) const;
+
+    // Adds the SigV4 headers; payloadHash is the hex SHA-256 of the body or UNSIGNED-PAYLOAD
+    void signRequest(QNetworkRequest& request, const QByteArray& method, const QByteArray& payloadHash) const;
+
+    static const qint64 MULTIPART_THRESHOLD = 64 * 1024 * 1024;
+    static const qint64 PART_SIZE = 16 * 1024 * 1024;
+    static const int MAX_PARALLEL_PARTS = 4;
+    static const int MAX_PART_ATTEMPTS = 3;
+
+signals:
+    // error is empty on success; etag is the stored object's, when the server returned one
+    void requestFinished(int requestId, const QString& error, const QString& etag);
+    void listFinished(int requestId, const QList<S3Object>& objects, const QString& error);
+
+private:
+    struct Operation {
+        QString bucket;
+        QString key;
+        QString localPath;
+        qint64 size = 0;
+
+        // Multipart state
+        QString uploadId;
+        int partCount = 0;
+        int nextPart = 1;
+        int partsDone = 0;
+        QMap<int, QString> etags;
+        QMap<int, int> attempts;
+        QList<int> retryParts;
+        QList<QNetworkReply*> replies;
+
+        QString etag;
+
+        // Listing state
+        bool listing = false;
+        QString prefix;
+        QString startAfter;
+        QString lastKey;
+        QList<S3Object> objects;
+    };
+
+    QNetworkReply* send(const QByteArray& method, const QUrl& url, QIODevice* body, qint64 size,
+                        const QByteArray& payloadHash, const QByteArray& contentType = QByteArray());
+    QNetworkReply* sendData(const QByteArray& method, const QUrl& url, const QByteArray& data,
+                            const QByteArray& contentType = QByteArray());
+
+    void startSinglePut(int id);
+    void startMultipart(int id);
+    void startParts(int id);
+    void onPartFinished(int id, int partNumber, QNetworkReply* reply);
+    void completeMultipart(int id);
+    void requestListPage(int id, const QString& continuationToken);
+    void finishOperation(int id, const QString& error);
+
+    static QString replyError(QNetworkReply* reply, const QByteArray& body);
+    static QString xmlValue(const QByteArray& xml, const QString& element);
+    static QString uploadIdQuery(const QString& uploadId);
+    static QByteArray contentTypeFor(const QString& path);
+
+    QNetworkAccessManager m_network;
+    QMap<int, Operation> m_operations;
+    int m_nextId = 1;
+    S3Config m_config;
+};
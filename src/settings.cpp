@@ -46,6 +46,50 @@ void Settings::setAwsProfile(const QString& profile)
     emit settingsChanged();
 }
 
+bool Settings::nativeS3Client() const
+{
+    return m_settings.value("aws/native_client", true).toBool();
+}
+
+void Settings::setNativeS3Client(bool enabled)
+{
+    m_settings.setValue("aws/native_client", enabled);
+    emit settingsChanged();
+}
+
+bool Settings::uploadBatching() const
+{
+    return m_settings.value("aws/batch_uploads", true).toBool();
+}
+
+void Settings::setUploadBatching(bool enabled)
+{
+    m_settings.setValue("aws/batch_uploads", enabled);
+    emit settingsChanged();
+}
+
+bool Settings::skipUnchangedUploads() const
+{
+    return m_settings.value("aws/skip_unchanged", true).toBool();
+}
+
+void Settings::setSkipUnchangedUploads(bool enabled)
+{
+    m_settings.setValue("aws/skip_unchanged", enabled);
+    emit settingsChanged();
+}
+
+QString Settings::s3Endpoint() const
+{
+    return m_settings.value("aws/endpoint").toString();
+}
+
+void Settings::setS3Endpoint(const QString& endpoint)
+{
+    m_settings.setValue("aws/endpoint", endpoint);
+    emit settingsChanged();
+}
+
 QString Settings::s3Bucket() const
 {
     return m_settings.value("aws/bucket", "decent-de1-media").toString();
@@ -68,6 +112,171 @@ void Settings::setMaxDownloadWidth(int width)
     emit settingsChanged();
 }
 
+int Settings::downloadMinConcurrency() const
+{
+    return m_settings.value("network/min_concurrency", 2).toInt();
+}
+
+void Settings::setDownloadMinConcurrency(int count)
+{
+    m_settings.setValue("network/min_concurrency", count);
+    emit settingsChanged();
+}
+
+int Settings::downloadMaxConcurrency() const
+{
+    return m_settings.value("network/max_concurrency", 16).toInt();
+}
+
+void Settings::setDownloadMaxConcurrency(int count)
+{
+    m_settings.setValue("network/max_concurrency", count);
+    emit settingsChanged();
+}
+
+bool Settings::downloadHedging() const
+{
+    return m_settings.value("network/hedging", true).toBool();
+}
+
+void Settings::setDownloadHedging(bool enabled)
+{
+    m_settings.setValue("network/hedging", enabled);
+    emit settingsChanged();
+}
+
+bool Settings::pipelineMode() const
+{
+    return m_settings.value("pipeline/enabled", false).toBool();
+}
+
+void Settings::setPipelineMode(bool enabled)
+{
+    m_settings.setValue("pipeline/enabled", enabled);
+    emit settingsChanged();
+}
+
+bool Settings::streamIngest() const
+{
+    return m_settings.value("media/stream_ingest", false).toBool();
+}
+
+void Settings::setStreamIngest(bool enabled)
+{
+    m_settings.setValue("media/stream_ingest", enabled);
+    emit settingsChanged();
+}
+
+bool Settings::ingestKeepRaw() const
+{
+    return m_settings.value("media/keep_raw", false).toBool();
+}
+
+void Settings::setIngestKeepRaw(bool enabled)
+{
+    m_settings.setValue("media/keep_raw", enabled);
+    emit settingsChanged();
+}
+
+int Settings::bandwidthCapKBps(const QString& name) const
+{
+    return m_settings.value("bandwidth/" + name + "_kbps", 0).toInt();
+}
+
+void Settings::setBandwidthCapKBps(const QString& name, int kbps)
+{
+    m_settings.setValue("bandwidth/" + name + "_kbps", kbps);
+    emit settingsChanged();
+}
+
+int Settings::bandwidthPeakStartHour() const
+{
+    return m_settings.value("bandwidth/peak_start_hour", 9).toInt();
+}
+
+void Settings::setBandwidthPeakStartHour(int hour)
+{
+    m_settings.setValue("bandwidth/peak_start_hour", hour);
+    emit settingsChanged();
+}
+
+int Settings::bandwidthPeakEndHour() const
+{
+    return m_settings.value("bandwidth/peak_end_hour", 18).toInt();
+}
+
+void Settings::setBandwidthPeakEndHour(int hour)
+{
+    m_settings.setValue("bandwidth/peak_end_hour", hour);
+    emit settingsChanged();
+}
+
+bool Settings::coverTargetSelection() const
+{
+    return m_settings.value("media/cover_target_selection", false).toBool();
+}
+
+void Settings::setCoverTargetSelection(bool enabled)
+{
+    m_settings.setValue("media/cover_target_selection", enabled);
+    emit settingsChanged();
+}
+
+int Settings::coverHeadroomPercent() const
+{
+    return m_settings.value("media/cover_headroom_percent", 0).toInt();
+}
+
+void Settings::setCoverHeadroomPercent(int percent)
+{
+    m_settings.setValue("media/cover_headroom_percent", percent);
+    emit settingsChanged();
+}
+
+bool Settings::cdnImageResize() const
+{
+    return m_settings.value("media/cdn_image_resize", false).toBool();
+}
+
+void Settings::setCdnImageResize(bool enabled)
+{
+    m_settings.setValue("media/cdn_image_resize", enabled);
+    emit settingsChanged();
+}
+
+bool Settings::verifyCdnImages() const
+{
+    return m_settings.value("media/verify_cdn_images", true).toBool();
+}
+
+void Settings::setVerifyCdnImages(bool enabled)
+{
+    m_settings.setValue("media/verify_cdn_images", enabled);
+    emit settingsChanged();
+}
+
+bool Settings::nativeImageScaler() const
+{
+    return m_settings.value("media/native_image_scaler", true).toBool();
+}
+
+void Settings::setNativeImageScaler(bool enabled)
+{
+    m_settings.setValue("media/native_image_scaler", enabled);
+    emit settingsChanged();
+}
+
+int Settings::jpegQuality() const
+{
+    return qBound(1, m_settings.value("media/jpeg_quality", 92).toInt(), 100);
+}
+
+void Settings::setJpegQuality(int quality)
+{
+    m_settings.setValue("media/jpeg_quality", quality);
+    emit settingsChanged();
+}
+
 int Settings::targetWidth() const
 {
     return m_settings.value("media/target_width", 1280).toInt();
@@ -112,12 +321,46 @@ void Settings::setFfmpegPreset(const QString& preset)
     emit settingsChanged();
 }
 
+int Settings::scaleCpuBudgetPercent() const
+{
+    return qBound(10, m_settings.value("media/cpu_budget", 75).toInt(), 100);
+}
+
+void Settings::setScaleCpuBudgetPercent(int percent)
+{
+    m_settings.setValue("media/cpu_budget", percent);
+    emit settingsChanged();
+}
+
 QString Settings::projectsDir() const
 {
     QString dataPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
     return dataPath + "/projects";
 }
 
+QString Settings::storeDir() const
+{
+    QString dataPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    return dataPath + "/store";
+}
+
+QString Settings::manifestsDir() const
+{
+    QString dataPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    return dataPath + "/manifests";
+}
+
+bool Settings::useMediaStore() const
+{
+    return m_settings.value("storage/shared_store", true).toBool();
+}
+
+void Settings::setUseMediaStore(bool enabled)
+{
+    m_settings.setValue("storage/shared_store", enabled);
+    emit settingsChanged();
+}
+
 QString Settings::lastProjectPath() const
 {
     return m_settings.value("app/last_project").toString();
@@ -22,10 +22,83 @@ public:
     QString s3Bucket() const;
     void setS3Bucket(const QString& bucket);
 
+    // Upload with the built-in S3 client instead of the aws CLI
+    bool nativeS3Client() const;
+    void setNativeS3Client(bool enabled);
+
+    // Send queued aws CLI uploads as one recursive copy per batch
+    bool uploadBatching() const;
+    void setUploadBatching(bool enabled);
+
+    // Skip uploads whose content the bucket's upload manifest says is already there
+    bool skipUnchangedUploads() const;
+    void setSkipUnchangedUploads(bool enabled);
+
+    // S3-compatible endpoint overriding the profile's (e.g. http://localhost:9000), empty for AWS
+    QString s3Endpoint() const;
+    void setS3Endpoint(const QString& endpoint);
+
     // Media settings
     int maxDownloadWidth() const;
     void setMaxDownloadWidth(int width);
 
+    // Bounds for the adaptive number of concurrent download connections
+    int downloadMinConcurrency() const;
+    void setDownloadMinConcurrency(int count);
+
+    int downloadMaxConcurrency() const;
+    void setDownloadMaxConcurrency(int count);
+
+    // Split straggling downloads onto idle connections at the end of a batch
+    bool downloadHedging() const;
+    void setDownloadHedging(bool enabled);
+
+    // Scale each item as soon as it is downloaded and upload it as soon as it is scaled
+    bool pipelineMode() const;
+    void setPipelineMode(bool enabled);
+
+    // Pipe video downloads straight into ffmpeg so only the scaled file is written
+    bool streamIngest() const;
+    void setStreamIngest(bool enabled);
+
+    // Also keep the raw file of streamed videos
+    bool ingestKeepRaw() const;
+    void setIngestKeepRaw(bool enabled);
+
+    // Bandwidth caps in KB/s (0 = unlimited) for "global", "bulk", "peak_bulk",
+    // "preview", "thumbnail" and "api". The last three are soft: reserved out of the
+    // global cap while the class is active (0 = reserve its measured rate)
+    int bandwidthCapKBps(const QString& name) const;
+    void setBandwidthCapKBps(const QString& name, int kbps);
+
+    // Local hours during which the peak bulk cap applies (equal = no peak window)
+    int bandwidthPeakStartHour() const;
+    void setBandwidthPeakStartHour(int hour);
+
+    int bandwidthPeakEndHour() const;
+    void setBandwidthPeakEndHour(int hour);
+
+    // Download the smallest rendition covering the target instead of the largest under max width
+    bool coverTargetSelection() const;
+    void setCoverTargetSelection(bool enabled);
+
+    int coverHeadroomPercent() const;
+    void setCoverHeadroomPercent(int percent);
+
+    // Fetch photos from the CDN already sized to the target, skipping the scale stage
+    bool cdnImageResize() const;
+    void setCdnImageResize(bool enabled);
+
+    bool verifyCdnImages() const;
+    void setVerifyCdnImages(bool enabled);
+
+    // Scale photos in-process instead of with ffmpeg, encoding at jpegQuality (1-100)
+    bool nativeImageScaler() const;
+    void setNativeImageScaler(bool enabled);
+
+    int jpegQuality() const;
+    void setJpegQuality(int quality);
+
     int targetWidth() const;
     void setTargetWidth(int width);
 
@@ -38,8 +111,18 @@ public:
     QString ffmpegPreset() const;
     void setFfmpegPreset(const QString& preset);
 
+    // Share of the CPU threads the concurrent scale jobs may use together
+    int scaleCpuBudgetPercent() const;
+    void setScaleCpuBudgetPercent(int percent);
+
     // Paths
     QString projectsDir() const;
+    QString storeDir() const;
+    QString manifestsDir() const;
+
+    // Project raw files become links into the shared media store
+    bool useMediaStore() const;
+    void setUseMediaStore(bool enabled);
     QString lastProjectPath() const;
     void setLastProjectPath(const QString& path);
 
@@ -1,5 +1,7 @@
 #include "uploadmanager.h"
 #include "settings.h"
+#include "mediastore.h"
+#include "imagescaler.h"
 #include <QFileInfo>
 #include <QFile>
 #include <QJsonDocument>
@@ -8,25 +10,90 @@
 #include <QDateTime>
 #include <QStandardPaths>
 #include <QDir>
+#include <QCoreApplication>
+#include <QSet>
+#include <QDebug>
+#include <QThread>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// Shard boundaries for listing a bucket: the catalogs, and the media split by the
+// leading digit of the media id in the file name
+const QStringList UploadManager::RECONCILE_SHARD_KEYS = {
+    "catalogs/", "media/", "media/1", "media/2", "media/3", "media/4",
+    "media/5", "media/6", "media/7", "media/8", "media/9"
+};
 
 UploadManager::UploadManager(QObject* parent)
     : QObject(parent)
+    , m_s3(this)
 {
+    m_scaleClock.start();
+    m_imagePool.setMaxThreadCount(MAX_CONCURRENT_SCALES);
+    m_hashPool.setMaxThreadCount(HASH_THREADS);
+
+    connect(&m_s3, &S3Client::requestFinished, this, [this](int requestId, const QString& error, const QString& etag) {
+        if (!m_nativeUploads.contains(requestId)) return;
+        finishUploadTask(m_nativeUploads.take(requestId), error, etag);
+    });
+    connect(&m_s3, &S3Client::listFinished, this,
+            [this](int requestId, const QList<S3Object>& objects, const QString& error) {
+        if (!m_listShards.contains(requestId)) return;
+        int reconcileId = m_listShards.take(requestId);
+        Reconcile& reconcile = m_reconciles[reconcileId];
+
+        reconcile.objects += objects;
+        if (!error.isEmpty()) {
+            reconcile.error = error;
+        }
+        if (--reconcile.pendingShards > 0) return;
+
+        Reconcile done = m_reconciles.take(reconcileId);
+        if (done.error.isEmpty()) {
+            UploadManifest& bucketManifest = manifest(done.bucket);
+            bucketManifest.rebuild(done.objects);
+            bucketManifest.save();
+        }
+        emit bucketReconciled(done.bucket, done.objects, done.error);
+    });
+}
+
+UploadManager::~UploadManager()
+{
+    // Running photo scales and hashes post their results back to this object
+    m_imagePool.clear();
+    m_imagePool.waitForDone();
+    m_hashPool.clear();
+    m_hashPool.waitForDone();
 }
 
 void UploadManager::scaleMedia(int mediaId, MediaType type, const QString& inputPath, const QString& outputPath,
-                                int targetWidth, int targetHeight, int crf, const QString& preset)
+                                int targetWidth, int targetHeight, int crf, const QString& preset, int durationSec)
+{
+    scaleLadder(mediaId, type, inputPath, {{outputPath, targetWidth, targetHeight, crf}}, preset, durationSec);
+}
+
+void UploadManager::scaleLadder(int mediaId, MediaType type, const QString& inputPath,
+                                const QList<ScaleOutput>& outputs, const QString& preset, int durationSec)
 {
+    if (outputs.isEmpty()) return;
+
     Task task;
     task.type = Scale;
     task.mediaType = type;
     task.mediaId = mediaId;
     task.inputPath = inputPath;
-    task.outputPath = outputPath;
-    task.targetWidth = targetWidth;
-    task.targetHeight = targetHeight;
-    task.crf = crf;
+    task.outputPath = outputs.first().path;
+    task.targetWidth = outputs.first().width;
+    task.targetHeight = outputs.first().height;
+    task.crf = outputs.first().crf;
     task.preset = preset;
+    task.durationSec = durationSec;
+    task.renditions = outputs.mid(1);
 
     m_scaleQueue.enqueue(task);
     startScaleTasks();
@@ -157,7 +224,8 @@ void UploadManager::uploadIndexJson(const QString& bucket, const QString& catego
     }
 }
 
-void UploadManager::uploadCatalogJson(const QString& bucket, const QString& categoryId, const QList<MediaMetadata>& media)
+void UploadManager::uploadCatalogJson(const QString& bucket, const QString& categoryId, const QList<MediaMetadata>& media,
+                                      const QList<Rendition>& renditions)
 {
     // Create catalog.json as simple array of media items with scaled files
     QJsonArray mediaArray;
@@ -179,6 +247,29 @@ void UploadManager::uploadCatalogJson(const QString& bucket, const QString& cate
             m["duration_s"] = item.duration;
         }
 
+        // The ladder's first rendition is "path"; the others are only listed when all are there
+        if (renditions.size() > 1) {
+            QJsonArray renditionArray;
+            for (int i = 0; i < renditions.size(); ++i) {
+                QFileInfo renditionInfo(i == 0 ? item.localScaledPath : item.renditionPaths.value(renditions[i].name));
+                if (!renditionInfo.exists()) {
+                    renditionArray = QJsonArray();
+                    break;
+                }
+
+                QJsonObject r;
+                r["name"] = renditions[i].name;
+                r["path"] = renditionInfo.fileName();
+                r["width"] = renditions[i].width;
+                r["height"] = renditions[i].height;
+                r["bytes"] = renditionInfo.size();
+                renditionArray.append(r);
+            }
+            if (!renditionArray.isEmpty()) {
+                m["renditions"] = renditionArray;
+            }
+        }
+
         mediaArray.append(m);
     }
 
@@ -289,6 +380,11 @@ void UploadManager::cancelAll()
         process->deleteLater();
     }
     m_runningScales.clear();
+    m_scaleThreadsInUse = 0;
+
+    // Photo scales already running finish, but their results are dropped
+    m_imagePool.clear();
+    m_imageScales.clear();
 
     // Kill all running upload processes
     for (auto process : m_runningUploads.keys()) {
@@ -297,6 +393,24 @@ void UploadManager::cancelAll()
     }
     m_runningUploads.clear();
 
+    m_s3.abortAll();
+    m_nativeUploads.clear();
+    m_listShards.clear();
+    m_reconciles.clear();
+    m_hashPool.clear();
+    m_contentChecks.clear();  // Hashes still running are dropped when they report
+    m_skippedUploads.clear();
+    saveManifests();
+
+    for (auto it = m_uploadBatches.begin(); it != m_uploadBatches.end(); ++it) {
+        it.key()->disconnect(this);
+        it.key()->kill();
+        it.key()->deleteLater();
+        QDir(it->stagingDir).removeRecursively();
+    }
+    m_uploadBatches.clear();
+    emit tasksCancelled();
+
     // Clean up temp files
     if (!m_tempIndexPath.isEmpty()) {
         QFile::remove(m_tempIndexPath);
@@ -314,60 +428,249 @@ void UploadManager::cancelAll()
 
 void UploadManager::startScaleTasks()
 {
-    while (m_runningScales.size() < MAX_CONCURRENT_SCALES && !m_scaleQueue.isEmpty()) {
+    int budget = scaleThreadBudget();
+
+    bool nativeImages = Settings::instance().nativeImageScaler();
+
+    while (m_runningScales.size() + m_imageScales.size() < MAX_CONCURRENT_SCALES && !m_scaleQueue.isEmpty()) {
+        int threads = threadsPerJob(m_scaleQueue.head().mediaType);
+
+        // One job always runs, so a budget below a job's threads cannot stall the queue
+        bool idle = m_runningScales.isEmpty() && m_imageScales.isEmpty();
+        if (!idle && m_scaleThreadsInUse + threads > budget) break;
+
         Task task = m_scaleQueue.dequeue();
+        task.threads = threads;
+        task.startedAt = m_scaleClock.elapsed();
+        m_scaleThreadsInUse += threads;
+
+        if (task.mediaType == MediaType::Image && nativeImages) {
+            startImageScale(task);
+            continue;
+        }
 
         auto process = new QProcess(this);
+        lowerPriority(process);
 
         connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
                 this, &UploadManager::onScaleProcessFinished);
         connect(process, &QProcess::errorOccurred,
                 this, &UploadManager::onScaleProcessError);
+        connect(process, &QProcess::readyReadStandardOutput, this, [this, process]() {
+            readScaleProgress(process);
+        });
+        connect(process, &QProcess::readyReadStandardError, this, [this, process]() {
+            readScaleErrors(process);
+        });
 
         m_runningScales[process] = task;
 
         emit scaleStarted(task.mediaId);
 
-        QStringList args;
+        // Progress as key=value blocks on stdout; stderr then only carries warnings and errors
+        QList<ScaleOutput> outputs = {{task.outputPath, task.targetWidth, task.targetHeight, task.crf}};
+        QStringList args = {"-hide_banner", "-nostats", "-progress", "pipe:1"};
+        args << ladderArguments(task.mediaType, task.inputPath, outputs + task.renditions, task.preset, task.threads);
+        process->start("ffmpeg", args);
+    }
+}
+
+void UploadManager::startImageScale(const Task& task)
+{
+    int jobId = m_nextImageScale++;
+    m_imageScales[jobId] = task;
+
+    emit scaleStarted(task.mediaId);
+
+    int quality = Settings::instance().jpegQuality();
+    QString inputPath = task.inputPath;
+    QList<ImageScaler::Output> outputs = {{task.outputPath, task.targetWidth, task.targetHeight}};
+    for (const auto& rendition : task.renditions) {
+        outputs.append({rendition.path, rendition.width, rendition.height});
+    }
 
-        if (task.mediaType == MediaType::Image) {
-            // Image scaling with ffmpeg
-            QString vf = QString("scale=%1:%2:force_original_aspect_ratio=increase,crop=%1:%2")
-                .arg(task.targetWidth)
-                .arg(task.targetHeight);
-
-            args << "-y"
-                 << "-i" << task.inputPath
-                 << "-vf" << vf
-                 << "-q:v" << "2"  // High quality JPEG
-                 << task.outputPath;
+    m_imagePool.start([this, jobId, inputPath, outputs, quality]() {
+        QString error = ImageScaler::scale(inputPath, outputs, quality);
+        QMetaObject::invokeMethod(this, [this, jobId, error]() {
+            finishImageScale(jobId, error);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void UploadManager::finishImageScale(int jobId, const QString& error)
+{
+    if (!m_imageScales.contains(jobId)) return;  // Cancelled
+
+    Task task = m_imageScales.take(jobId);
+    m_scaleThreadsInUse -= task.threads;
+
+    if (!error.isEmpty()) {
+        emit scaleError(task.mediaId, error);
+    } else {
+        m_scaleStats.images++;
+        m_scaleStats.imageSeconds += (m_scaleClock.elapsed() - task.startedAt) / 1000.0;
+        emit scaleCompleted(task.mediaId, task.outputPath);
+    }
+
+    startScaleTasks();
+
+    if (allTasksDone()) {
+        saveManifests();
+        emit allTasksCompleted();
+    }
+}
+
+int UploadManager::scaleThreadBudget()
+{
+    int cores = qMax(1, QThread::idealThreadCount());
+    return qMax(1, cores * Settings::instance().scaleCpuBudgetPercent() / 100);
+}
+
+int UploadManager::threadsPerJob(MediaType type)
+{
+    // libx264 gains little past a few threads at our output size, so several narrow
+    // encodes beat one wide one; a photo is a single-threaded decode and encode
+    if (type == MediaType::Image) return 1;
+    return qMin(VIDEO_JOB_THREADS, scaleThreadBudget());
+}
+
+void UploadManager::lowerPriority(QProcess* process)
+{
+#ifdef Q_OS_WIN
+    process->setCreateProcessArgumentsModifier([](QProcess::CreateProcessArguments* args) {
+        args->flags |= BELOW_NORMAL_PRIORITY_CLASS;
+    });
+#else
+    process->setChildProcessModifier([]() {
+        int ignored = ::nice(10);
+        Q_UNUSED(ignored);
+    });
+#endif
+}
+
+QStringList UploadManager::scaleArguments(MediaType type, const QString& inputPath, const QString& outputPath,
+                                          int targetWidth, int targetHeight, int crf, const QString& preset,
+                                          int threads)
+{
+    QString vf = QString("scale=%1:%2:force_original_aspect_ratio=increase,crop=%1:%2")
+        .arg(targetWidth)
+        .arg(targetHeight);
+
+    QStringList args;
+    QStringList threadArgs;
+    if (threads > 0) {
+        threadArgs << "-threads" << QString::number(threads);
+    }
+
+    if (type == MediaType::Image) {
+        // Image scaling with ffmpeg
+        args << "-y"
+             << threadArgs
+             << "-i" << inputPath
+             << "-vf" << vf
+             << "-q:v" << "2"  // High quality JPEG
+             << outputPath;
+    } else {
+        // Video scaling with ffmpeg; -threads before -i sizes the decoder, after it the encoder
+        args << "-y"
+             << threadArgs
+             << "-i" << inputPath
+             << "-an"
+             << "-vf" << vf
+             << "-c:v" << "libx264"
+             << "-preset" << preset
+             << "-crf" << QString::number(crf)
+             << threadArgs
+             << "-pix_fmt" << "yuv420p"
+             << "-movflags" << "+faststart"
+             << outputPath;
+    }
+
+    return args;
+}
+
+QStringList UploadManager::ladderArguments(MediaType type, const QString& inputPath,
+                                           const QList<ScaleOutput>& outputs, const QString& preset, int threads)
+{
+    if (outputs.size() == 1) {
+        const ScaleOutput& output = outputs.first();
+        return scaleArguments(type, inputPath, output.path, output.width, output.height, output.crf, preset, threads);
+    }
+
+    QStringList args;
+    args << "-y";
+    if (threads > 0) {
+        args << "-threads" << QString::number(threads);
+    }
+    args << "-i" << inputPath;
+
+    // [0:v]split=2[in0][in1];[in0]scale=...,crop=...[out0];[in1]scale=...,crop=...[out1]
+    QString split = QString("[0:v]split=%1").arg(outputs.size());
+    QStringList graph;
+    for (int i = 0; i < outputs.size(); ++i) {
+        const auto& output = outputs[i];
+        split += QString("[in%1]").arg(i);
+        graph << QString("[in%1]scale=%2:%3:force_original_aspect_ratio=increase,crop=%2:%3[out%1]")
+                     .arg(i).arg(output.width).arg(output.height);
+    }
+    graph.prepend(split);
+    args << "-filter_complex" << graph.join(';');
+
+    int encoderThreads = threads > 0 ? qMax(1, threads / int(outputs.size())) : 0;
+
+    for (int i = 0; i < outputs.size(); ++i) {
+        const auto& output = outputs[i];
+        args << "-map" << QString("[out%1]").arg(i);
+        if (type == MediaType::Image) {
+            args << "-q:v" << "2";  // High quality JPEG
         } else {
-            // Video scaling with ffmpeg
-            QString vf = QString("scale=%1:%2:force_original_aspect_ratio=increase,crop=%1:%2")
-                .arg(task.targetWidth)
-                .arg(task.targetHeight);
-
-            args << "-y"
-                 << "-i" << task.inputPath
-                 << "-an"
-                 << "-vf" << vf
-                 << "-c:v" << "libx264"
-                 << "-preset" << task.preset
-                 << "-crf" << QString::number(task.crf)
-                 << "-pix_fmt" << "yuv420p"
-                 << "-movflags" << "+faststart"
-                 << task.outputPath;
+            args << "-c:v" << "libx264"
+                 << "-preset" << preset
+                 << "-crf" << QString::number(output.crf);
+            if (encoderThreads > 0) {
+                args << "-threads" << QString::number(encoderThreads);
+            }
+            args << "-pix_fmt" << "yuv420p"
+                 << "-movflags" << "+faststart";
         }
-
-        process->start("ffmpeg", args);
+        args << output.path;
     }
+
+    return args;
 }
 
 void UploadManager::startUploadTasks()
 {
-    while (m_runningUploads.size() < MAX_CONCURRENT_UPLOADS && !m_uploadQueue.isEmpty()) {
+    auto& settings = Settings::instance();
+
+    // Credentials are re-read per batch so profile edits apply without a restart
+    if (m_runningUploads.isEmpty() && m_nativeUploads.isEmpty() && m_uploadBatches.isEmpty()
+        && !m_uploadQueue.isEmpty()) {
+        loadS3Config();
+        if (settings.nativeS3Client() && !m_s3.config().isValid()) {
+            qDebug() << "No static credentials for AWS profile" << settings.awsProfile() << "- using the aws CLI";
+        }
+    }
+    bool native = settings.nativeS3Client() && m_s3.config().isValid();
+
+    startContentChecks();
+
+    while (m_runningUploads.size() + m_nativeUploads.size() + m_uploadBatches.size() < MAX_CONCURRENT_UPLOADS
+           && !m_uploadQueue.isEmpty()) {
         Task task = m_uploadQueue.dequeue();
 
+        if (native) {
+            if (task.type == Upload) {
+                emit uploadStarted(task.mediaId);
+            }
+            startNativeUpload(task);
+            continue;
+        }
+
+        if (task.type == Upload && settings.uploadBatching() && startUploadBatch(task)) {
+            continue;
+        }
+
         auto process = new QProcess(this);
 
         connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
@@ -382,7 +685,6 @@ void UploadManager::startUploadTasks()
         }
 
         QStringList args;
-        QString profile = Settings::instance().awsProfile();
 
         if (task.type == S3Delete) {
             // Delete catalog file for this category
@@ -394,28 +696,212 @@ void UploadManager::startUploadTasks()
             args << "s3" << "cp" << task.inputPath << s3Path;
         }
 
-        if (!profile.isEmpty() && profile != "default") {
-            args << "--profile" << profile;
-        }
+        args << awsProfileArguments();
 
         process->start("aws", args);
     }
 }
 
+QStringList UploadManager::awsProfileArguments() const
+{
+    QString profile = Settings::instance().awsProfile();
+    if (profile.isEmpty() || profile == "default") return QStringList();
+    return {"--profile", profile};
+}
+
+bool UploadManager::startUploadBatch(const Task& first)
+{
+    int slash = first.key.lastIndexOf('/');
+    QString prefix = first.key.left(slash + 1);
+
+    // Queued uploads to the same bucket and prefix travel together; a file name can
+    // only be staged once, so a duplicate waits for the next batch
+    QList<Task> tasks = {first};
+    QSet<QString> names = {first.key.mid(slash + 1)};
+    for (auto it = m_uploadQueue.begin(); it != m_uploadQueue.end() && tasks.size() < MAX_BATCH_FILES;) {
+        QString name = it->key.mid(prefix.size());
+        if (it->type == Upload && it->bucket == first.bucket && it->key.startsWith(prefix)
+            && !name.contains('/') && !names.contains(name)) {
+            Task task = *it;
+            it = m_uploadQueue.erase(it);
+            names.insert(name);
+            tasks.append(task);
+        } else {
+            ++it;
+        }
+    }
+
+    if (tasks.size() < 2) return false;
+
+    // Staged next to the files so the hardlinks stay on their volume
+    UploadBatch batch;
+    batch.stagingDir = QFileInfo(first.inputPath).absolutePath()
+        + QString("/.upload-batch-%1-%2").arg(QCoreApplication::applicationPid()).arg(m_nextBatch++);
+    batch.destination = QString("s3://%1/%2").arg(first.bucket, prefix);
+    QDir(batch.stagingDir).removeRecursively();
+    QDir().mkpath(batch.stagingDir);
+
+    bool firstStaged = true;
+    for (const Task& task : tasks) {
+        QString name = task.key.mid(prefix.size());
+
+        // Never copied: copying hundreds of files here would stall the GUI
+        if (!MediaStore::linkFile(task.inputPath, batch.stagingDir + "/" + name, false)) {
+            // Not linkable (e.g. missing, or on another volume): the single-file path takes it
+            if (task.key == first.key) {
+                firstStaged = false;
+            } else {
+                m_uploadQueue.prepend(task);
+            }
+            continue;
+        }
+        batch.files[name] = task;
+    }
+
+    // Returning false hands first to the caller, so it is only queued again otherwise
+    if (batch.files.isEmpty()) {
+        QDir(batch.stagingDir).removeRecursively();
+        return false;
+    }
+    if (!firstStaged) {
+        m_uploadQueue.prepend(first);
+    }
+
+    auto process = new QProcess(this);
+    connect(process, &QProcess::readyReadStandardOutput, this, &UploadManager::onBatchOutput);
+    connect(process, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+            this, &UploadManager::onBatchFinished);
+    connect(process, &QProcess::errorOccurred, this, [this, process](QProcess::ProcessError error) {
+        if (error == QProcess::FailedToStart) {
+            finishBatch(process, -1, QProcess::CrashExit);
+        }
+    });
+    m_uploadBatches[process] = batch;
+
+    for (const Task& task : batch.files) {
+        emit uploadStarted(task.mediaId);
+    }
+
+    qDebug() << "Uploading" << batch.files.size() << "files to" << batch.destination << "in one batch";
+
+    QStringList args;
+    args << "s3" << "cp" << batch.stagingDir << batch.destination << "--recursive" << "--no-progress"
+         << awsProfileArguments();
+    process->start("aws", args);
+    return true;
+}
+
+void UploadManager::onBatchOutput()
+{
+    auto process = qobject_cast<QProcess*>(sender());
+    if (!process || !m_uploadBatches.contains(process)) return;
+
+    UploadBatch& batch = m_uploadBatches[process];
+    batch.output += process->readAllStandardOutput();
+
+    int newline;
+    while ((newline = batch.output.indexOf('\n')) >= 0) {
+        QString line = QString::fromUtf8(batch.output.left(newline)).trimmed();
+        batch.output.remove(0, newline + 1);
+        handleBatchLine(batch, line);
+    }
+}
+
+void UploadManager::handleBatchLine(UploadBatch& batch, const QString& line)
+{
+    // "upload: <staged> to s3://bucket/prefix/name" or
+    // "upload failed: <staged> to s3://bucket/prefix/name <error>"
+    bool failed = line.startsWith("upload failed:");
+    if (!failed && !line.startsWith("upload:")) return;
+
+    int dest = line.indexOf(" to " + batch.destination);
+    if (dest < 0) return;
+    QString rest = line.mid(dest + 4 + batch.destination.size());
+
+    // A success line ends with the name, which may contain spaces. A failure line appends
+    // the error, so its name is the longest file of the batch that rest starts with.
+    QString name;
+    if (!failed) {
+        name = rest;
+    } else {
+        for (auto it = batch.files.cbegin(); it != batch.files.cend(); ++it) {
+            const QString& candidate = it.key();
+            if (candidate.size() <= name.size()) continue;
+            if (rest == candidate || rest.startsWith(candidate + ' ')) name = candidate;
+        }
+    }
+
+    if (!batch.files.contains(name)) return;
+    Task task = batch.files.take(name);
+
+    if (failed) {
+        QString error = rest.mid(name.size()).trimmed();
+        emit uploadError(task.mediaId, error.isEmpty() ? QString("Upload failed") : error);
+    } else {
+        recordUpload(task, QString());
+        emit uploadCompleted(task.mediaId);
+    }
+}
+
+void UploadManager::onBatchFinished(int exitCode, QProcess::ExitStatus status)
+{
+    finishBatch(qobject_cast<QProcess*>(sender()), exitCode, status);
+}
+
+void UploadManager::finishBatch(QProcess* process, int exitCode, QProcess::ExitStatus status)
+{
+    if (!process || !m_uploadBatches.contains(process)) return;
+
+    process->disconnect(this);
+    UploadBatch batch = m_uploadBatches.take(process);
+    batch.output += process->readAllStandardOutput();
+    batch.output += '\n';
+    for (const QByteArray& line : batch.output.split('\n')) {
+        handleBatchLine(batch, QString::fromUtf8(line).trimmed());
+    }
+
+    QString errorOutput = QString::fromUtf8(process->readAllStandardError()).trimmed();
+    process->deleteLater();
+    QDir(batch.stagingDir).removeRecursively();
+
+    // Files the CLI never reported did not make it
+    if (!batch.files.isEmpty()) {
+        QString error = !errorOutput.isEmpty() ? errorOutput
+            : status != QProcess::NormalExit ? QString("aws cli failed to run")
+            : QString("Exit code: %1").arg(exitCode);
+        for (const Task& task : batch.files) {
+            emit uploadError(task.mediaId, error);
+        }
+    }
+
+    startUploadTasks();
+
+    if (allTasksDone()) {
+        saveManifests();
+        emit allTasksCompleted();
+    }
+}
+
 void UploadManager::onScaleProcessFinished(int exitCode, QProcess::ExitStatus status)
 {
     auto process = qobject_cast<QProcess*>(sender());
     if (!process || !m_runningScales.contains(process)) return;
 
-    Task task = m_runningScales.take(process);
+    readScaleProgress(process);
+    readScaleErrors(process);
 
-    QString errorOutput = process->readAllStandardError();
+    Task task = m_runningScales.take(process);
+    m_scaleThreadsInUse -= task.threads;
     process->deleteLater();
 
     if (status != QProcess::NormalExit || exitCode != 0) {
+        QString errorOutput = QString::fromUtf8(task.stderrTail).trimmed();
         QString error = errorOutput.isEmpty() ? QString("Exit code: %1").arg(exitCode) : errorOutput;
         emit scaleError(task.mediaId, error);
     } else {
+        if (task.mediaType == MediaType::Video) {
+            recordScaleStats(task);
+        }
         emit scaleCompleted(task.mediaId, task.outputPath);
     }
 
@@ -423,8 +909,8 @@ void UploadManager::onScaleProcessFinished(int exitCode, QProcess::ExitStatus st
     startScaleTasks();
 
     // Check if all done
-    if (m_runningScales.isEmpty() && m_scaleQueue.isEmpty() &&
-        m_runningUploads.isEmpty() && m_uploadQueue.isEmpty()) {
+    if (allTasksDone()) {
+        saveManifests();
         emit allTasksCompleted();
     }
 }
@@ -435,6 +921,7 @@ void UploadManager::onScaleProcessError(QProcess::ProcessError error)
     if (!process || !m_runningScales.contains(process)) return;
 
     Task task = m_runningScales.take(process);
+    m_scaleThreadsInUse -= task.threads;
     process->deleteLater();
 
     QString errorMsg;
@@ -454,8 +941,8 @@ void UploadManager::onScaleProcessError(QProcess::ProcessError error)
 
     startScaleTasks();
 
-    if (m_runningScales.isEmpty() && m_scaleQueue.isEmpty() &&
-        m_runningUploads.isEmpty() && m_uploadQueue.isEmpty()) {
+    if (allTasksDone()) {
+        saveManifests();
         emit allTasksCompleted();
     }
 }
@@ -470,9 +957,59 @@ void UploadManager::onUploadProcessFinished(int exitCode, QProcess::ExitStatus s
     QString errorOutput = process->readAllStandardError();
     process->deleteLater();
 
+    QString error;
     if (status != QProcess::NormalExit || exitCode != 0) {
-        QString error = errorOutput.isEmpty() ? QString("Exit code: %1").arg(exitCode) : errorOutput;
+        error = errorOutput.isEmpty() ? QString("Exit code: %1").arg(exitCode) : errorOutput;
+    }
+    finishUploadTask(task, error);
+}
+
+void UploadManager::onUploadProcessError(QProcess::ProcessError error)
+{
+    auto process = qobject_cast<QProcess*>(sender());
+    if (!process || !m_runningUploads.contains(process)) return;
+
+    Task task = m_runningUploads.take(process);
+    process->deleteLater();
 
+    QString errorMsg;
+    switch (error) {
+        case QProcess::FailedToStart:
+            errorMsg = "aws cli not found. Please install AWS CLI.";
+            break;
+        case QProcess::Crashed:
+            errorMsg = "aws cli crashed";
+            break;
+        default:
+            errorMsg = "Unknown process error";
+            break;
+    }
+
+    finishUploadTask(task, errorMsg);
+}
+
+void UploadManager::startNativeUpload(const Task& task)
+{
+    int requestId;
+    if (task.type == S3Delete) {
+        requestId = m_s3.deleteObject(task.bucket, QString("catalogs/%1.json").arg(task.categoryId));
+    } else {
+        requestId = m_s3.putObject(task.bucket, task.key, task.inputPath);
+    }
+    m_nativeUploads[requestId] = task;
+}
+
+void UploadManager::finishUploadTask(const Task& task, const QString& error, const QString& etag)
+{
+    if (error.isEmpty() && !task.unchanged) {
+        if (task.type == S3Delete) {
+            manifest(task.bucket).remove(QString("catalogs/%1.json").arg(task.categoryId));
+        } else {
+            recordUpload(task, etag);
+        }
+    }
+
+    if (!error.isEmpty()) {
         if (task.type == Upload) {
             emit uploadError(task.mediaId, error);
         } else if (task.type == IndexUpload || task.type == CatalogUpload) {
@@ -515,47 +1052,213 @@ void UploadManager::onUploadProcessFinished(int exitCode, QProcess::ExitStatus s
     startUploadTasks();
 
     // Check if all done
-    if (m_runningScales.isEmpty() && m_scaleQueue.isEmpty() &&
-        m_runningUploads.isEmpty() && m_uploadQueue.isEmpty()) {
+    if (allTasksDone()) {
+        saveManifests();
         emit allTasksCompleted();
     }
 }
 
-void UploadManager::onUploadProcessError(QProcess::ProcessError error)
+void UploadManager::startContentChecks()
 {
-    auto process = qobject_cast<QProcess*>(sender());
-    if (!process || !m_runningUploads.contains(process)) return;
+    // Without skipping there is nothing to compare; such an upload clears the key's
+    // manifest entry instead of recording one (see recordUpload)
+    if (!Settings::instance().skipUnchangedUploads()) return;
+
+    // Uploads wait off the queue while a worker hashes them, so the GUI never reads
+    // a file and batches only ever see uploads that are known to be needed
+    for (auto it = m_uploadQueue.begin(); it != m_uploadQueue.end();) {
+        if (it->type == S3Delete || it->type == Scale || it->checked) {
+            ++it;
+            continue;
+        }
 
-    Task task = m_runningUploads.take(process);
-    process->deleteLater();
+        Task task = *it;
+        it = m_uploadQueue.erase(it);
+        task.checked = true;
+
+        int jobId = m_nextContentCheck++;
+        m_contentChecks.insert(jobId, task);
+        QString path = task.inputPath;
+        bool withMd5 = manifest(task.bucket).needsMd5(task.key);
+        m_hashPool.start([this, jobId, path, withMd5]() {
+            UploadManifest::Digest digest = UploadManifest::digest(path, withMd5);
+            QMetaObject::invokeMethod(this, [this, jobId, digest]() {
+                finishContentCheck(jobId, digest);
+            }, Qt::QueuedConnection);
+        });
+    }
+}
 
-    QString errorMsg;
-    switch (error) {
-        case QProcess::FailedToStart:
-            errorMsg = "aws cli not found. Please install AWS CLI.";
-            break;
-        case QProcess::Crashed:
-            errorMsg = "aws cli crashed";
-            break;
-        default:
-            errorMsg = "Unknown process error";
-            break;
+void UploadManager::finishContentCheck(int jobId, const UploadManifest::Digest& digest)
+{
+    if (!m_contentChecks.contains(jobId)) return;  // Cancelled
+
+    Task task = m_contentChecks.take(jobId);
+    task.contentHash = digest.hash;
+    task.contentSize = digest.size;
+
+    if (!manifest(task.bucket).isUnchanged(task.key, digest)) {
+        // Unreadable files go ahead too, so the upload reports the error
+        m_uploadQueue.enqueue(task);
+        startUploadTasks();
+        return;
     }
 
+    // Reported on the next event loop pass, like a finished upload
+    task.unchanged = true;
     if (task.type == Upload) {
-        emit uploadError(task.mediaId, errorMsg);
-    } else if (task.type == IndexUpload || task.type == CatalogUpload) {
-        emit indexUploadError(errorMsg);
-    } else if (task.type == CategoriesUpload) {
-        emit categoriesUploadError(errorMsg);
-    } else if (task.type == S3Delete) {
-        emit s3DeleteError(task.bucket, errorMsg);
+        emit uploadStarted(task.mediaId);
+    }
+    m_skippedUploads.append(task);
+    if (m_skippedUploads.size() == 1) {
+        QMetaObject::invokeMethod(this, &UploadManager::flushSkippedUploads, Qt::QueuedConnection);
     }
+}
 
-    startUploadTasks();
+void UploadManager::flushSkippedUploads()
+{
+    QList<Task> skipped = m_skippedUploads;
+    m_skippedUploads.clear();
+    m_skippedCount += skipped.size();
 
-    if (m_runningScales.isEmpty() && m_scaleQueue.isEmpty() &&
-        m_runningUploads.isEmpty() && m_uploadQueue.isEmpty()) {
-        emit allTasksCompleted();
+    for (const Task& task : skipped) {
+        finishUploadTask(task, QString());
+    }
+}
+
+void UploadManager::recordUpload(const Task& task, const QString& etag)
+{
+    // An old entry must not vouch for content that was uploaded unhashed
+    if (task.contentHash.isEmpty()) {
+        manifest(task.bucket).remove(task.key);
+        return;
+    }
+    manifest(task.bucket).record(task.key, task.contentSize, task.contentHash, etag);
+}
+
+UploadManifest& UploadManager::manifest(const QString& bucket)
+{
+    auto it = m_manifests.find(bucket);
+    if (it == m_manifests.end()) {
+        it = m_manifests.insert(bucket, std::make_shared<UploadManifest>(bucket));
     }
+    return **it;
+}
+
+void UploadManager::saveManifests()
+{
+    for (auto& bucketManifest : m_manifests) {
+        bucketManifest->save();
+    }
+    if (m_skippedCount > 0) {
+        qDebug() << "Skipped" << m_skippedCount << "uploads already in the bucket";
+        m_skippedCount = 0;
+    }
+}
+
+bool UploadManager::loadS3Config()
+{
+    auto& settings = Settings::instance();
+    S3Config config = S3Config::fromProfile(settings.awsProfile());
+    if (!settings.s3Endpoint().isEmpty()) {
+        config.endpoint = settings.s3Endpoint();
+    }
+    m_s3.setConfig(config);
+    return config.isValid();
+}
+
+void UploadManager::reconcileBucket(const QString& bucket)
+{
+    if (!loadS3Config()) {
+        emit bucketReconciled(bucket, {}, "Listing the bucket needs static credentials in the AWS profile");
+        return;
+    }
+
+    // Shard i covers the keys in (boundary i-1, boundary i], so together they list every key once
+    int reconcileId = m_nextReconcile++;
+    Reconcile& reconcile = m_reconciles[reconcileId];
+    reconcile.bucket = bucket;
+
+    QString startAfter;
+    for (int i = 0; i <= RECONCILE_SHARD_KEYS.size(); ++i) {
+        QString lastKey = i < RECONCILE_SHARD_KEYS.size() ? RECONCILE_SHARD_KEYS[i] : QString();
+        m_listShards[m_s3.listObjects(bucket, QString(), startAfter, lastKey)] = reconcileId;
+        reconcile.pendingShards++;
+        startAfter = lastKey;
+    }
+}
+
+void UploadManager::readScaleProgress(QProcess* process)
+{
+    auto it = m_runningScales.find(process);
+    if (it == m_runningScales.end()) return;
+
+    Task& task = it.value();
+    task.progressOutput += process->readAllStandardOutput();
+
+    int newline;
+    while ((newline = task.progressOutput.indexOf('\n')) >= 0) {
+        QByteArray line = task.progressOutput.left(newline).trimmed();
+        task.progressOutput.remove(0, newline + 1);
+
+        int separator = line.indexOf('=');
+        if (separator <= 0) continue;
+        QByteArray key = line.left(separator);
+        QByteArray value = line.mid(separator + 1).trimmed();
+
+        ScaleProgress& progress = task.progress;
+        if (key == "frame") {
+            progress.frames = value.toLongLong();
+        } else if (key == "fps") {
+            progress.fps = value.toDouble();
+        } else if (key == "out_time_us") {
+            progress.outTime = value.toLongLong() / 1000000.0;  // "N/A" reads as 0
+        } else if (key == "speed") {
+            if (value.endsWith('x')) value.chop(1);
+            progress.speed = value.toDouble();
+        } else if (key == "progress") {
+            // Ends each block ("continue", or "end" for the last)
+            if (task.durationSec > 0 && progress.speed > 0) {
+                progress.etaSeconds = qMax(0, int((task.durationSec - progress.outTime) / progress.speed));
+            }
+            if (value == "end") progress.etaSeconds = 0;
+            emit scaleProgress(task.mediaId, progress);
+        }
+    }
+}
+
+void UploadManager::readScaleErrors(QProcess* process)
+{
+    auto it = m_runningScales.find(process);
+    if (it == m_runningScales.end()) return;
+
+    // Only the tail is kept: the end of the log is where ffmpeg says what went wrong
+    QByteArray& tail = it.value().stderrTail;
+    tail += process->readAllStandardError();
+    if (tail.size() > STDERR_TAIL_BYTES) {
+        tail.remove(0, tail.size() - STDERR_TAIL_BYTES);
+    }
+}
+
+void UploadManager::recordScaleStats(const Task& task)
+{
+    qint64 frames = task.progress.frames;
+    double seconds = (m_scaleClock.elapsed() - task.startedAt) / 1000.0;
+    if (frames <= 0 || seconds <= 0) return;
+
+    m_scaleStats.frames += frames;
+    m_scaleStats.seconds += seconds;
+    m_scaleStats.threadSeconds += seconds * task.threads;
+
+    qDebug() << "Scaled" << task.mediaId << ":" << frames << "frames in" << seconds << "s on" << task.threads
+             << "threads," << frames / seconds << "fps," << frames / (seconds * task.threads) << "fps/core,"
+             << task.progress.speed << "x realtime; overall" << m_scaleStats.framesPerCoreSecond() << "fps/core";
+}
+
+bool UploadManager::allTasksDone() const
+{
+    return m_runningScales.isEmpty() && m_imageScales.isEmpty() && m_scaleQueue.isEmpty() &&
+           m_runningUploads.isEmpty() && m_nativeUploads.isEmpty() &&
+           m_uploadBatches.isEmpty() && m_contentChecks.isEmpty() && m_skippedUploads.isEmpty() &&
+           m_uploadQueue.isEmpty();
 }
@@ -4,7 +4,12 @@
 #include <QProcess>
 #include <QQueue>
 #include <QMap>
+#include <QElapsedTimer>
+#include <QThreadPool>
 #include "mediametadata.h"
+#include "s3client.h"
+#include "uploadmanifest.h"
+#include <memory>
 
 class UploadManager : public QObject
 {
@@ -12,24 +17,93 @@ class UploadManager : public QObject
 
 public:
     explicit UploadManager(QObject* parent = nullptr);
+    ~UploadManager() override;
 
+    // durationSec (0 if unknown) lets scaleProgress estimate the time left
     void scaleMedia(int mediaId, MediaType type, const QString& inputPath, const QString& outputPath,
-                    int targetWidth, int targetHeight, int crf, const QString& preset);
+                    int targetWidth, int targetHeight, int crf, const QString& preset, int durationSec = 0);
+
+    // One output of a scale job
+    struct ScaleOutput {
+        QString path;
+        int width = 0;
+        int height = 0;
+        int crf = 0;
+    };
+
+    // Scales to every output from one decode of the source; scaleCompleted reports the first
+    void scaleLadder(int mediaId, MediaType type, const QString& inputPath, const QList<ScaleOutput>& outputs,
+                     const QString& preset, int durationSec = 0);
+
     void uploadToS3(int mediaId, const QString& localPath, const QString& bucket, const QString& key);
     void uploadIndexJson(const QString& bucket, const QString& categoryId, const QString& projectName);
-    void uploadCatalogJson(const QString& bucket, const QString& categoryId, const QList<MediaMetadata>& media);
+    // With a rendition ladder, each item lists its renditions besides the first one's "path"
+    void uploadCatalogJson(const QString& bucket, const QString& categoryId, const QList<MediaMetadata>& media,
+                           const QList<Rendition>& renditions = QList<Rendition>());
     void uploadCategoriesJson(const QString& bucket, const QString& categoryId, const QString& projectName);
     void deleteFromS3(const QString& bucket, const QString& categoryId);
     void removeCategoryAndUpload(const QString& bucket, const QString& categoryId);
     void cancelAll();
 
-    bool isBusy() const { return !m_runningScales.isEmpty() || !m_runningUploads.isEmpty() || !m_scaleQueue.isEmpty() || !m_uploadQueue.isEmpty(); }
+    // Lists the whole bucket, in parallel key-range shards, and rebuilds its upload
+    // manifest from the result. Reported by bucketReconciled.
+    void reconcileBucket(const QString& bucket);
+
+    // ffmpeg command line for one scale job; inputPath may be "pipe:0" for streamed input.
+    // threads > 0 caps ffmpeg's decoder and encoder threads.
+    static QStringList scaleArguments(MediaType type, const QString& inputPath, const QString& outputPath,
+                                      int targetWidth, int targetHeight, int crf, const QString& preset,
+                                      int threads = 0);
+
+    // ffmpeg command line decoding inputPath once and splitting it into a scale, crop and
+    // encode branch per output; threads are shared out between the branch encoders
+    static QStringList ladderArguments(MediaType type, const QString& inputPath, const QList<ScaleOutput>& outputs,
+                                       const QString& preset, int threads = 0);
+
+    // Threads all scale jobs may use together: the CPU budget's share of the cores
+    static int scaleThreadBudget();
+
+    // Threads one job of the type gets; jobs start while their sum fits the budget
+    static int threadsPerJob(MediaType type);
+
+    // Runs an encode below normal priority so it yields to the GUI and the rest of the
+    // system; call before start()
+    static void lowerPriority(QProcess* process);
+
+    // Live state of a running scale job, from ffmpeg's -progress output
+    struct ScaleProgress {
+        qint64 frames = 0;
+        double fps = 0.0;
+        double speed = 0.0;    // Media seconds encoded per second
+        double outTime = 0.0;  // Seconds of output written
+        int etaSeconds = -1;   // -1 while unknown
+    };
+
+    // Throughput of the finished video jobs and in-process photo scales
+    struct ScaleStats {
+        qint64 frames = 0;
+        double seconds = 0.0;
+        double threadSeconds = 0.0;
+        qint64 images = 0;
+        double imageSeconds = 0.0;
+
+        double framesPerCoreSecond() const { return threadSeconds > 0 ? frames / threadSeconds : 0.0; }
+    };
+    ScaleStats scaleStats() const { return m_scaleStats; }
+
+    bool isBusy() const { return !m_runningScales.isEmpty() || !m_imageScales.isEmpty() || !m_runningUploads.isEmpty() || !m_nativeUploads.isEmpty() || !m_uploadBatches.isEmpty() || !m_contentChecks.isEmpty() || !m_skippedUploads.isEmpty() || !m_scaleQueue.isEmpty() || !m_uploadQueue.isEmpty(); }
 
     static const int MAX_CONCURRENT_SCALES = 8;
+    static const int VIDEO_JOB_THREADS = 4;
+    static const int STDERR_TAIL_BYTES = 8 * 1024;
     static const int MAX_CONCURRENT_UPLOADS = 8;
+    static const int MAX_BATCH_FILES = 500;
+    static const int HASH_THREADS = 2;  // Reading is disk bound; more only adds seeks
+    static const QStringList RECONCILE_SHARD_KEYS;
 
 signals:
     void scaleStarted(int mediaId);
+    void scaleProgress(int mediaId, const UploadManager::ScaleProgress& progress);
     void scaleCompleted(int mediaId, const QString& outputPath);
     void scaleError(int mediaId, const QString& error);
 
@@ -47,12 +121,17 @@ signals:
     void s3DeleteError(const QString& bucket, const QString& error);
 
     void allTasksCompleted();
+    void tasksCancelled();  // After cancelAll(); the cancelled tasks report nothing
+
+    void bucketReconciled(const QString& bucket, const QList<S3Object>& objects, const QString& error);
 
 private slots:
     void onScaleProcessFinished(int exitCode, QProcess::ExitStatus status);
     void onScaleProcessError(QProcess::ProcessError error);
     void onUploadProcessFinished(int exitCode, QProcess::ExitStatus status);
     void onUploadProcessError(QProcess::ProcessError error);
+    void onBatchOutput();
+    void onBatchFinished(int exitCode, QProcess::ExitStatus status);
 
 private:
     void startScaleTasks();
@@ -74,16 +153,94 @@ private:
         int targetHeight;
         int crf;
         QString preset;
+
+        // Local content, for the upload manifest
+        QString contentHash;
+        qint64 contentSize = -1;
+        bool checked = false;    // Compared with the manifest already
+        bool unchanged = false;  // Skipped: the bucket already has this content
+
+        // Scale job accounting
+        int threads = 1;
+        qint64 startedAt = 0;
+        int durationSec = 0;
+        QList<ScaleOutput> renditions;  // Further outputs from the same decode
+        ScaleProgress progress;
+        QByteArray progressOutput;  // Unparsed -progress lines
+        QByteArray stderrTail;      // Last STDERR_TAIL_BYTES of ffmpeg's log
     };
 
+    void startNativeUpload(const Task& task);
+    void finishUploadTask(const Task& task, const QString& error, const QString& etag = QString());
+    void startContentChecks();
+    void finishContentCheck(int jobId, const UploadManifest::Digest& digest);
+    void flushSkippedUploads();
+    void recordUpload(const Task& task, const QString& etag);
+    UploadManifest& manifest(const QString& bucket);
+    void saveManifests();
+    bool loadS3Config();
+    bool allTasksDone() const;
+    void startImageScale(const Task& task);
+    void finishImageScale(int jobId, const QString& error);
+    void readScaleProgress(QProcess* process);
+    void readScaleErrors(QProcess* process);
+    void recordScaleStats(const Task& task);
+    bool startUploadBatch(const Task& first);
+    QStringList awsProfileArguments() const;
+
+    // One "aws s3 cp --recursive" over a staging directory of hardlinks
+    struct UploadBatch {
+        QString stagingDir;
+        QString destination;         // s3://bucket/prefix/
+        QMap<QString, Task> files;   // Staged file name -> task, until reported
+        QByteArray output;           // Unparsed stdout
+    };
+    void handleBatchLine(UploadBatch& batch, const QString& line);
+    void finishBatch(QProcess* process, int exitCode, QProcess::ExitStatus status);
+
     // Scale processes (up to MAX_CONCURRENT_SCALES)
     QMap<QProcess*, Task> m_runningScales;
+    int m_scaleThreadsInUse = 0;
+    QElapsedTimer m_scaleClock;
+    ScaleStats m_scaleStats;
+
+    // Photos scaled in-process by ImageScaler, by job id
+    QThreadPool m_imagePool;
+    QMap<int, Task> m_imageScales;
+    int m_nextImageScale = 1;
     QQueue<Task> m_scaleQueue;
 
     // Upload processes (up to MAX_CONCURRENT_UPLOADS)
     QMap<QProcess*, Task> m_runningUploads;
     QQueue<Task> m_uploadQueue;
 
+    // Uploads running in the built-in S3 client, by request id
+    S3Client m_s3;
+    QMap<int, Task> m_nativeUploads;
+
+    QMap<QProcess*, UploadBatch> m_uploadBatches;
+
+    QMap<QString, std::shared_ptr<UploadManifest>> m_manifests;  // By bucket
+
+    // Uploads being hashed for the manifest comparison, by job id
+    QThreadPool m_hashPool;
+    QMap<int, Task> m_contentChecks;
+    int m_nextContentCheck = 1;
+
+    QList<Task> m_skippedUploads;
+    int m_skippedCount = 0;  // Since the last allTasksCompleted
+
+    struct Reconcile {
+        QString bucket;
+        int pendingShards = 0;
+        QList<S3Object> objects;
+        QString error;
+    };
+    QMap<int, Reconcile> m_reconciles;
+    QMap<int, int> m_listShards;  // S3 list request id -> reconcile id
+    int m_nextReconcile = 1;
+    int m_nextBatch = 1;
+
     QString m_tempIndexPath;
     QString m_tempCatalogPath;
     QString m_tempCategoriesPath;
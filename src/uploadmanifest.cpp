@@ -0,0 +1,156 @@
+#include "uploadmanifest.h"
+#include "settings.h"
+#include "contenthash.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QCryptographicHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QRegularExpression>
+#include <QDebug>
+
+UploadManifest::UploadManifest(const QString& bucket)
+    : m_bucket(bucket)
+{
+    QString dir = Settings::instance().manifestsDir();
+    QDir().mkpath(dir);
+    QString name = bucket;
+    name.replace(QRegularExpression("[^A-Za-z0-9._-]"), "_");
+    m_path = dir + "/" + name + ".json";
+    load();
+}
+
+UploadManifest::Digest UploadManifest::digest(const QString& path, bool withMd5)
+{
+    Digest result;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return result;
+
+    ContentHash hasher;
+    QCryptographicHash md5(QCryptographicHash::Md5);
+    QByteArray buffer(1024 * 1024, Qt::Uninitialized);
+    qint64 read;
+    while ((read = file.read(buffer.data(), buffer.size())) > 0) {
+        hasher.addData(buffer.constData(), read);
+        if (withMd5) md5.addData(QByteArray::fromRawData(buffer.constData(), read));
+    }
+    if (read < 0) return result;
+
+    result.ok = true;
+    result.size = hasher.length();
+    result.hash = ContentHash::toHex(hasher.result());
+    if (withMd5) result.md5 = md5.result().toHex();
+    return result;
+}
+
+bool UploadManifest::needsMd5(const QString& key) const
+{
+    auto it = m_entries.constFind(key);
+    return it != m_entries.constEnd() && it->hash.isEmpty() && it->etag.size() == 32 && !it->etag.contains('-');
+}
+
+bool UploadManifest::isUnchanged(const QString& key, const Digest& digest)
+{
+    if (!digest.ok) return false;
+
+    auto it = m_entries.find(key);
+    if (it == m_entries.end() || it->size != digest.size) return false;
+
+    if (!it->hash.isEmpty()) {
+        return it->hash == digest.hash;
+    }
+
+    // Known only from a listing: a single-part upload's ETag is the MD5 of the content
+    if (digest.md5.isEmpty() || digest.md5 != it->etag.toLatin1()) return false;
+
+    it->hash = digest.hash;
+    m_dirty = true;
+    return true;
+}
+
+void UploadManifest::record(const QString& key, qint64 size, const QString& hash, const QString& etag)
+{
+    Entry entry;
+    entry.size = size;
+    entry.hash = hash;
+    entry.etag = etag;
+    entry.uploaded = QDateTime::currentDateTimeUtc();
+    m_entries[key] = entry;
+    m_dirty = true;
+}
+
+void UploadManifest::remove(const QString& key)
+{
+    if (m_entries.remove(key) > 0) {
+        m_dirty = true;
+    }
+}
+
+void UploadManifest::rebuild(const QList<S3Object>& objects)
+{
+    QMap<QString, Entry> entries;
+    int kept = 0;
+    for (const auto& object : objects) {
+        Entry entry;
+        entry.size = object.size;
+        entry.etag = object.etag;
+        entry.uploaded = object.lastModified;
+
+        // Without a recorded ETag there is no telling whether the object was replaced
+        // since, so only hashes backed by a matching ETag survive
+        auto old = m_entries.constFind(object.key);
+        if (old != m_entries.constEnd() && old->size == object.size
+            && !old->etag.isEmpty() && old->etag == object.etag) {
+            entry.hash = old->hash;
+            kept++;
+        }
+        entries[object.key] = entry;
+    }
+
+    qDebug() << "Upload manifest for" << m_bucket << "rebuilt:" << entries.size() << "objects,"
+             << kept << "hashes kept," << (m_entries.size() - kept) << "entries dropped or replaced";
+    m_entries = entries;
+    m_dirty = true;
+}
+
+void UploadManifest::load()
+{
+    QFile file(m_path);
+    if (!file.open(QIODevice::ReadOnly)) return;
+
+    QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+    for (auto it = root.begin(); it != root.end(); ++it) {
+        QJsonObject json = it.value().toObject();
+        Entry entry;
+        entry.size = json["size"].toInteger(-1);
+        entry.hash = json["hash"].toString();
+        entry.etag = json["etag"].toString();
+        entry.uploaded = QDateTime::fromString(json["uploaded"].toString(), Qt::ISODate);
+        m_entries[it.key()] = entry;
+    }
+}
+
+void UploadManifest::save()
+{
+    if (!m_dirty) return;
+
+    QJsonObject root;
+    for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        QJsonObject json;
+        json["size"] = it->size;
+        json["hash"] = it->hash;
+        json["etag"] = it->etag;
+        json["uploaded"] = it->uploaded.toString(Qt::ISODate);
+        root[it.key()] = json;
+    }
+
+    QSaveFile file(m_path);
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+        if (file.commit()) {
+            m_dirty = false;
+        }
+    }
+}
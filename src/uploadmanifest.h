@@ -0,0 +1,64 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QMap>
+#include <QDateTime>
+#include "s3client.h"
+
+// What was last uploaded to each key of one bucket, kept under Settings::manifestsDir().
+// An upload whose local file matches its manifest entry (same size and content hash,
+// or for entries known only from a listing the same MD5 ETag) can be skipped.
+class UploadManifest
+{
+public:
+    struct Entry {
+        qint64 size = -1;
+        QString hash;      // XXH64 of the uploaded file, empty if only known from a listing
+        QString etag;
+        QDateTime uploaded;
+    };
+
+    explicit UploadManifest(const QString& bucket);
+
+    const QString& bucket() const { return m_bucket; }
+
+    // A local file's content, read once for both hashes
+    struct Digest {
+        bool ok = false;   // False if the file could not be read
+        qint64 size = -1;
+        QString hash;      // XXH64, hex
+        QByteArray md5;    // Hex, only when asked for
+    };
+
+    // Reads path; safe to call on a worker thread
+    static Digest digest(const QString& path, bool withMd5);
+
+    // True if comparing key needs the file's MD5: its entry is known only from a
+    // listing, with a single-part upload's ETag
+    bool needsMd5(const QString& key) const;
+
+    // True if key already holds the digested content
+    bool isUnchanged(const QString& key, const Digest& digest);
+
+    void record(const QString& key, qint64 size, const QString& hash, const QString& etag);
+    void remove(const QString& key);
+
+    // Replaces the entries with a bucket listing, keeping hashes where size and a recorded ETag still match
+    void rebuild(const QList<S3Object>& objects);
+
+    bool contains(const QString& key) const { return m_entries.contains(key); }
+    Entry entry(const QString& key) const { return m_entries.value(key); }
+    QStringList keys() const { return m_entries.keys(); }
+    int size() const { return m_entries.size(); }
+
+    void save();
+
+private:
+    void load();
+
+    QString m_bucket;
+    QString m_path;
+    QMap<QString, Entry> m_entries;
+    bool m_dirty = false;
+};
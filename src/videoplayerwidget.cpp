@@ -1,9 +1,12 @@
 #include "videoplayerwidget.h"
+#include "bandwidthscheduler.h"
+#include "networkservice.h"
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QDebug>
 #include <QNetworkReply>
 #include <QPixmap>
+#include <QMediaMetaData>
 
 VideoPlayerWidget::VideoPlayerWidget(QWidget* parent)
     : QWidget(parent)
@@ -89,6 +92,16 @@ void VideoPlayerWidget::setupUi()
     connect(m_player, &QMediaPlayer::errorOccurred, this, [](QMediaPlayer::Error error, const QString& errorString) {
         qDebug() << "MediaPlayer error:" << error << errorString;
     });
+    connect(m_player, &QMediaPlayer::metaDataChanged, this, [this]() {
+        if (m_previewBitRate == 0) return;
+        QMediaMetaData metaData = m_player->metaData();
+        qint64 bitRate = metaData.value(QMediaMetaData::VideoBitRate).toLongLong()
+            + metaData.value(QMediaMetaData::AudioBitRate).toLongLong();
+        if (bitRate > 0) {
+            m_previewBitRate = bitRate;
+            updatePreviewRate();
+        }
+    });
     connect(m_player, &QMediaPlayer::mediaStatusChanged, this, [](QMediaPlayer::MediaStatus status) {
         qDebug() << "MediaPlayer status:" << status;
     });
@@ -103,6 +116,11 @@ void VideoPlayerWidget::setupUi()
 void VideoPlayerWidget::playUrl(const QUrl& url)
 {
     qDebug() << "VideoPlayerWidget::playUrl" << url;
+    // Streaming previews get their reserved share while bulk downloads run. The player
+    // fetches them itself, so the scheduler is told their bitrate instead of their bytes.
+    m_previewBitRate = PREVIEW_BITRATE_GUESS;
+    updatePreviewRate();
+    BandwidthScheduler::instance().setActive(BandwidthScheduler::Preview, true);
     showVideoMode();
     m_player->setSource(url);
     m_player->play();
@@ -111,6 +129,9 @@ void VideoPlayerWidget::playUrl(const QUrl& url)
 void VideoPlayerWidget::playFile(const QString& path)
 {
     qDebug() << "VideoPlayerWidget::playFile" << path;
+    m_previewBitRate = 0;
+    updatePreviewRate();
+    BandwidthScheduler::instance().setActive(BandwidthScheduler::Preview, false);
     showVideoMode();
     m_player->setSource(QUrl::fromLocalFile(path));
     m_player->play();
@@ -119,19 +140,25 @@ void VideoPlayerWidget::playFile(const QString& path)
 void VideoPlayerWidget::showImageUrl(const QUrl& url)
 {
     qDebug() << "VideoPlayerWidget::showImageUrl" << url;
+    m_previewBitRate = 0;
+    updatePreviewRate();
+    BandwidthScheduler::instance().setActive(BandwidthScheduler::Preview, false);
     m_player->stop();
     showImageMode();
     m_imageLabel->setText("Loading...");
 
-    QNetworkRequest request(url);
-    request.setRawHeader("User-Agent", "PexelManager/1.0");
-    auto reply = m_imageNetwork.get(request);
-    connect(reply, &QNetworkReply::finished, this, &VideoPlayerWidget::onImageLoaded);
+    NetworkService::instance().get(QNetworkRequest(url), BandwidthScheduler::Preview, this,
+                                   [this](QNetworkReply* reply) {
+        connect(reply, &QNetworkReply::finished, this, &VideoPlayerWidget::onImageLoaded);
+    });
 }
 
 void VideoPlayerWidget::showImageFile(const QString& path)
 {
     qDebug() << "VideoPlayerWidget::showImageFile" << path;
+    m_previewBitRate = 0;
+    updatePreviewRate();
+    BandwidthScheduler::instance().setActive(BandwidthScheduler::Preview, false);
     m_player->stop();
     showImageMode();
 
@@ -146,11 +173,21 @@ void VideoPlayerWidget::showImageFile(const QString& path)
 
 void VideoPlayerWidget::stop()
 {
+    m_previewBitRate = 0;
+    updatePreviewRate();
+    BandwidthScheduler::instance().setActive(BandwidthScheduler::Preview, false);
     m_player->stop();
     m_player->setSource(QUrl());
     m_imageLabel->clear();
 }
 
+void VideoPlayerWidget::updatePreviewRate()
+{
+    // Faster playback pulls the stream proportionally faster
+    qint64 bytesPerSecond = static_cast<qint64>(m_previewBitRate / 8 * m_player->playbackRate());
+    BandwidthScheduler::instance().setExpectedRate(BandwidthScheduler::Preview, bytesPerSecond);
+}
+
 void VideoPlayerWidget::showVideoMode()
 {
     m_stack->setCurrentIndex(0);
@@ -169,8 +206,11 @@ void VideoPlayerWidget::onImageLoaded()
     if (!reply) return;
 
     if (reply->error() == QNetworkReply::NoError) {
+        QByteArray data = reply->readAll();
+        BandwidthScheduler::instance().consume(BandwidthScheduler::Preview, data.size());
+
         QPixmap pixmap;
-        if (pixmap.loadFromData(reply->readAll())) {
+        if (pixmap.loadFromData(data)) {
             m_imageLabel->setPixmap(pixmap.scaled(m_imageLabel->size(),
                 Qt::KeepAspectRatio, Qt::SmoothTransformation));
         } else {
@@ -220,6 +260,7 @@ void VideoPlayerWidget::onSpeedSliderChanged(int value)
 {
     qreal rate = value / 10.0;
     m_player->setPlaybackRate(rate);
+    updatePreviewRate();
     m_speedLabel->setText(QString("%1x").arg(rate, 0, 'f', 1));
     emit playbackRateChanged(rate);
 }
@@ -8,7 +8,6 @@
 #include <QPushButton>
 #include <QAudioOutput>
 #include <QStackedWidget>
-#include <QNetworkAccessManager>
 
 class VideoPlayerWidget : public QWidget
 {
@@ -46,6 +45,10 @@ private:
     void showVideoMode();
     void showImageMode();
     QString formatTime(qint64 ms) const;
+    void updatePreviewRate();
+
+    // Assumed until the stream's metadata reports its bitrate
+    static const qint64 PREVIEW_BITRATE_GUESS = 2000000;
 
     QStackedWidget* m_stack;
 
@@ -56,7 +59,6 @@ private:
 
     // Image
     QLabel* m_imageLabel;
-    QNetworkAccessManager m_imageNetwork;
 
     // Controls
     QWidget* m_controlsWidget;
@@ -67,4 +69,5 @@ private:
     QPushButton* m_playPauseBtn;
 
     bool m_seeking = false;
+    qint64 m_previewBitRate = 0;  // Bits per second of the streamed preview, 0 when not streaming
 };